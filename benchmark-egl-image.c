@@ -0,0 +1,347 @@
+#include <epoxy/gl.h>
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gtkeglimagewidget.h"
+
+/* what meson reads as a skipped run */
+#define EXIT_SKIP 77
+
+#define BENCH_TYPE_WIDGET (bench_widget_get_type ())
+G_DECLARE_FINAL_TYPE (BenchWidget, bench_widget, BENCH, WIDGET, GtkEglImageWidget)
+
+struct _BenchWidget
+{
+  GtkEglImageWidget parent_instance;
+
+  EGLDisplay display;
+  EGLContext context;
+  EGLenum sync_type;
+  guint frame;
+};
+
+G_DEFINE_TYPE (BenchWidget, bench_widget, GTK_TYPE_EGL_IMAGE_WIDGET);
+
+static void
+bench_widget_init (BenchWidget *bench)
+{
+}
+
+static void
+bench_widget_resize (GtkEglImageWidget *ewidget, int width, int height)
+{
+  BenchWidget *bench = BENCH_WIDGET (ewidget);
+
+  if (!eglMakeCurrent (bench->display, EGL_NO_SURFACE, EGL_NO_SURFACE, bench->context))
+    return;
+
+  glViewport (0, 0, width, height);
+}
+
+static EGLImage
+bench_widget_render (GtkEglImageWidget *ewidget)
+{
+  BenchWidget *bench = BENCH_WIDGET (ewidget);
+  const GtkEglImageRenderTarget *target;
+  EGLSyncKHR sync = EGL_NO_SYNC_KHR;
+  float phase;
+
+  if (!eglMakeCurrent (bench->display, EGL_NO_SURFACE, EGL_NO_SURFACE, bench->context))
+    return EGL_NO_IMAGE;
+  if (!eglBindAPI (EGL_OPENGL_API))
+    return EGL_NO_IMAGE;
+
+  target = gtk_egl_image_widget_acquire_render_target (ewidget);
+  if (!target)
+    return EGL_NO_IMAGE;
+
+  phase = (bench->frame++ % 60) / 60.f;
+  glBindFramebuffer (GL_FRAMEBUFFER, target->framebuffer);
+  glClearColor (phase, 1.f - phase, 0.5f, 1.f);
+  glClear (GL_COLOR_BUFFER_BIT);
+
+  if (bench->sync_type)
+    sync = eglCreateSyncKHR (bench->display, bench->sync_type, NULL);
+  if (sync != EGL_NO_SYNC_KHR)
+    {
+      glFlush ();
+      gtk_egl_image_widget_set_render_sync (ewidget, sync);
+    }
+  else
+    glFinish ();
+
+  return target->image;
+}
+
+static void
+bench_widget_realize (GtkWidget *widget)
+{
+  BenchWidget *bench = BENCH_WIDGET (widget);
+  EGLConfig config;
+  EGLint num_configs;
+
+  const EGLint config_attribs[] = {
+    EGL_RED_SIZE,             8,
+    EGL_GREEN_SIZE,           8,
+    EGL_BLUE_SIZE,            8,
+    EGL_ALPHA_SIZE,           8,
+    EGL_CONFORMANT,           EGL_OPENGL_BIT,
+    EGL_RENDERABLE_TYPE,      EGL_OPENGL_BIT,
+    EGL_NONE,
+  };
+
+  GTK_WIDGET_CLASS (bench_widget_parent_class)->realize (widget);
+
+  bench->display = gtk_egl_image_widget_get_egl_display (GTK_EGL_IMAGE_WIDGET (bench));
+  if (!bench->display)
+    return;
+  if (!eglBindAPI (EGL_OPENGL_API)
+      || !eglChooseConfig (bench->display, config_attribs, &config, 1, &num_configs)
+      || num_configs < 1)
+    {
+      gtk_egl_image_widget_set_last_egl_error (GTK_EGL_IMAGE_WIDGET (bench), "Benchmark eglChooseConfig");
+      return;
+    }
+  bench->context = eglCreateContext (bench->display, config, EGL_NO_CONTEXT, NULL);
+  if (bench->context == EGL_NO_CONTEXT)
+    {
+      gtk_egl_image_widget_set_last_egl_error (GTK_EGL_IMAGE_WIDGET (bench), "Benchmark eglCreateContext");
+      return;
+    }
+
+  if (epoxy_has_egl_extension (bench->display, "EGL_ANDROID_native_fence_sync"))
+    bench->sync_type = EGL_SYNC_NATIVE_FENCE_ANDROID;
+  else if (epoxy_has_egl_extension (bench->display, "EGL_KHR_fence_sync"))
+    bench->sync_type = EGL_SYNC_FENCE_KHR;
+}
+
+static void
+bench_widget_unrealize (GtkWidget *widget)
+{
+  BenchWidget *bench = BENCH_WIDGET (widget);
+
+  if (bench->context != EGL_NO_CONTEXT)
+    {
+      eglMakeCurrent (bench->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+      eglDestroyContext (bench->display, bench->context);
+      bench->context = EGL_NO_CONTEXT;
+    }
+
+  GTK_WIDGET_CLASS (bench_widget_parent_class)->unrealize (widget);
+}
+
+static void
+bench_widget_class_init (BenchWidgetClass *class)
+{
+  GtkEglImageWidgetClass *ei_class = GTK_EGL_IMAGE_WIDGET_CLASS (class);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (class);
+
+  ei_class->render = bench_widget_render;
+  ei_class->resize = bench_widget_resize;
+
+  widget_class->realize = bench_widget_realize;
+  widget_class->unrealize = bench_widget_unrealize;
+}
+
+static int n_frames = 300;
+static char *path_name = NULL;
+static char **sizes = NULL;
+
+static const char * const path_names[] = { "dmabuf", "glx", "egl", "mmap", "readback", NULL };
+
+static const GOptionEntry entries[] = {
+  { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames, "Frames to render per size", "N" },
+  { "path", 'p', 0, G_OPTION_ARG_STRING, &path_name, "Import path the widget must use", "NAME" },
+  { "size", 's', 0, G_OPTION_ARG_STRING_ARRAY, &sizes, "Size to render at (repeatable)", "WxH" },
+  { NULL }
+};
+
+static gboolean
+wait_for_size (GtkWidget *widget, int width, int height)
+{
+  gint64 deadline = g_get_monotonic_time () + 5 * G_USEC_PER_SEC;
+
+  while (g_get_monotonic_time () < deadline)
+    {
+      if (gtk_widget_get_mapped (widget)
+          && (gtk_egl_image_widget_is_ready (GTK_EGL_IMAGE_WIDGET (widget))
+              || gtk_egl_image_widget_get_error (GTK_EGL_IMAGE_WIDGET (widget)))
+          && gtk_widget_get_width (widget) == width
+          && gtk_widget_get_height (widget) == height)
+        return TRUE;
+      g_main_context_iteration (NULL, TRUE);
+    }
+
+  return FALSE;
+}
+
+static int
+compare_int64 (gconstpointer a, gconstpointer b)
+{
+  gint64 ia = *(const gint64 *) a;
+  gint64 ib = *(const gint64 *) b;
+
+  return ia < ib ? -1 : ia > ib;
+}
+
+static int
+run_size (GtkWidget *window, GtkWidget *widget, int width, int height)
+{
+  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (widget);
+  GskRenderer *renderer = gtk_native_get_renderer (GTK_NATIVE (window));
+  g_autoptr (GdkPaintable) paintable = gtk_widget_paintable_new (widget);
+  g_autofree gint64 *latencies = g_new (gint64, n_frames);
+  const graphene_rect_t probe = GRAPHENE_RECT_INIT (0.f, 0.f, 1.f, 1.f);
+  guint64 hits, misses, start_misses;
+  gint64 start, total, sum = 0;
+  gint64 import_min = 0, import_avg = 0, import_p99 = 0;
+  guint switches, skipped;
+  const char *import_path;
+  guchar pixel[4];
+
+  gtk_widget_set_size_request (widget, width, height);
+  if (!wait_for_size (widget, width, height))
+    {
+      g_printerr ("%s: widget never reached %dx%d\n", g_get_prgname (), width, height);
+      return 1;
+    }
+  if (gtk_egl_image_widget_get_error (ewidget))
+    {
+      g_printerr ("%s: %s\n", g_get_prgname (), gtk_egl_image_widget_get_error (ewidget)->message);
+      return 1;
+    }
+  if (path_name != NULL && !gtk_egl_image_widget_has_import_path (ewidget, path_name))
+    {
+      g_printerr ("%s: the %s path is not available here\n", g_get_prgname (), path_name);
+      return EXIT_SKIP;
+    }
+
+  gtk_egl_image_widget_stats_reset (gtk_egl_image_widget_get_stats (ewidget));
+  gtk_egl_image_widget_get_buffer_pool_stats (ewidget, &hits, &start_misses);
+
+  start = g_get_monotonic_time ();
+  for (int i = 0; i < n_frames; i++)
+    {
+      gint64 frame_start = g_get_monotonic_time ();
+      g_autoptr (GtkSnapshot) snapshot = gtk_snapshot_new ();
+      g_autoptr (GskRenderNode) node = NULL;
+
+      gtk_egl_image_widget_queue_render (ewidget);
+      gdk_paintable_snapshot (paintable, GDK_SNAPSHOT (snapshot), width, height);
+      node = gtk_snapshot_to_node (snapshot);
+
+      /* rendering and downloading a single pixel forces the import to
+       * complete without measuring a full-size download */
+      if (node)
+        {
+          g_autoptr (GdkTexture) texture = gsk_renderer_render_texture (renderer, node, &probe);
+
+          gdk_texture_download (texture, pixel, 4);
+        }
+
+      latencies[i] = g_get_monotonic_time () - frame_start;
+      sum += latencies[i];
+
+      if (gtk_egl_image_widget_get_error (ewidget))
+        {
+          g_printerr ("%s: %s\n", g_get_prgname (), gtk_egl_image_widget_get_error (ewidget)->message);
+          return 1;
+        }
+    }
+  total = g_get_monotonic_time () - start;
+
+  /* GDK picks the path from the environment, so a run that silently fell
+   * back to another one must not be reported under the requested name */
+  import_path = gtk_egl_image_widget_get_import_path (ewidget);
+  if (import_path == NULL)
+    import_path = "none";
+  if (path_name != NULL && g_strcmp0 (import_path, path_name) != 0)
+    {
+      g_printerr ("%s: expected the %s path but the widget used %s\n",
+                  g_get_prgname (), path_name, import_path);
+      return 1;
+    }
+
+  gtk_egl_image_widget_get_buffer_pool_stats (ewidget, &hits, &misses);
+  gtk_egl_image_widget_stats_get_timing (gtk_egl_image_widget_get_stats (ewidget),
+                                         GTK_EGL_IMAGE_WIDGET_STAGE_IMPORT,
+                                         &import_min, &import_avg, &import_p99);
+  gtk_egl_image_widget_stats_get_context_switches (gtk_egl_image_widget_get_stats (ewidget),
+                                                   &switches, &skipped);
+  qsort (latencies, n_frames, sizeof (gint64), compare_int64);
+
+  g_print ("%-10s %5dx%-5d %8.1f fps  latency avg %6.2f ms p99 %6.2f ms  "
+           "import avg %6.2f ms  allocations %" G_GUINT64_FORMAT
+           "  context switches %u (%u skipped)\n",
+           import_path, width, height,
+           n_frames * (double) G_USEC_PER_SEC / total,
+           sum / (double) n_frames / 1000.0,
+           latencies[(n_frames * 99 + 99) / 100 - 1] / 1000.0,
+           import_avg / 1000.0,
+           misses - start_misses
+           + gtk_egl_image_widget_stats_get_allocations (gtk_egl_image_widget_get_stats (ewidget)),
+           switches, skipped);
+
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_autoptr (GOptionContext) context = NULL;
+  g_autoptr (GError) error = NULL;
+  static const char *default_sizes[] = { "256x256", "1280x720", "1920x1080", NULL };
+  GtkWidget *window;
+  GtkWidget *fixed;
+  GtkWidget *widget;
+  int status = 0;
+
+  context = g_option_context_new ("- benchmark GtkEglImageWidget presentation");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return 1;
+    }
+  if (n_frames < 1)
+    n_frames = 1;
+  if (path_name != NULL && !g_strv_contains (path_names, path_name))
+    {
+      g_printerr ("Unknown path '%s'\n", path_name);
+      return 1;
+    }
+
+  gtk_init ();
+
+  /* a GtkFixed allocates the widget exactly its size request, whatever
+   * size the window ends up with */
+  window = gtk_window_new ();
+  fixed = gtk_fixed_new ();
+  widget = g_object_new (BENCH_TYPE_WIDGET, "auto-render", FALSE, "render-scale", 1.0,
+                         "allow-mmap", g_strcmp0 (path_name, "readback") != 0, NULL);
+  gtk_fixed_put (GTK_FIXED (fixed), widget, 0, 0);
+  gtk_window_set_child (GTK_WINDOW (window), fixed);
+  gtk_window_present (GTK_WINDOW (window));
+
+  for (const char * const *s = sizes ? (const char * const *) sizes : default_sizes; *s; s++)
+    {
+      int width, height;
+
+      if (sscanf (*s, "%dx%d", &width, &height) != 2 || width < 1 || height < 1)
+        {
+          g_printerr ("Invalid size '%s'\n", *s);
+          status = 1;
+          break;
+        }
+      status = run_size (window, widget, width, height);
+      if (status != 0)
+        break;
+    }
+
+  gtk_window_destroy (GTK_WINDOW (window));
+  g_strfreev (sizes);
+  g_free (path_name);
+
+  return status;
+}
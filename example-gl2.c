@@ -15,24 +15,16 @@ struct _ExampleGl2Cube
 
   EGLDisplay display;
   EGLContext context;
-  GLuint fb;
   GLuint rb;
+  EGLenum sync_type;
   gint64 start_time;
 };
 
 G_DEFINE_TYPE (ExampleGl2Cube, example_gl2_cube, GTK_TYPE_EGL_IMAGE_WIDGET);
 
-static gboolean
-tick (GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data)
-{
-  gtk_widget_queue_draw (widget);
-  return TRUE;
-}
-
 static void
 example_gl2_cube_init (ExampleGl2Cube *cube)
 {
-  gtk_widget_add_tick_callback (GTK_WIDGET (cube), tick, NULL, NULL);
 }
 
 static void
@@ -45,6 +37,9 @@ example_gl2_cube_resize (GtkEglImageWidget *ewidget, int width, int height)
   if (!eglBindAPI (EGL_OPENGL_API))
     return;
 
+  glBindRenderbuffer (GL_RENDERBUFFER, cube->rb);
+  glRenderbufferStorage (GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height);
+
   glViewport (0, 0, width, height);
   glMatrixMode (GL_PROJECTION);
   glLoadIdentity ();
@@ -56,9 +51,8 @@ static EGLImage
 example_gl2_cube_render (GtkEglImageWidget *ewidget)
 {
   ExampleGl2Cube *cube = EXAMPLE_GL2_CUBE (ewidget);
-  GLuint tex;
-  int width, height;
-  EGLImage image;
+  const GtkEglImageRenderTarget *target;
+  EGLSyncKHR sync = EGL_NO_SYNC_KHR;
   gint64 cur_time;
 
   if (!eglMakeCurrent (cube->display, EGL_NO_SURFACE, EGL_NO_SURFACE, cube->context))
@@ -66,14 +60,12 @@ example_gl2_cube_render (GtkEglImageWidget *ewidget)
   if (!eglBindAPI (EGL_OPENGL_API))
     return EGL_NO_IMAGE;
 
-  width = gtk_widget_get_width (GTK_WIDGET (GTK_EGL_IMAGE_WIDGET (cube)));
-  height = gtk_widget_get_height (GTK_WIDGET (GTK_EGL_IMAGE_WIDGET (cube)));
+  target = gtk_egl_image_widget_acquire_render_target (ewidget);
+  if (!target)
+    return EGL_NO_IMAGE;
 
-  glGenTextures (1, &tex);
-  glBindTexture (GL_TEXTURE_2D, tex);
-  glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-  glRenderbufferStorage (GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height);
-  glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+  glBindFramebuffer (GL_FRAMEBUFFER, target->framebuffer);
+  glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, cube->rb);
 
   cur_time = g_get_monotonic_time ();
   if (cube->start_time < 0)
@@ -122,27 +114,24 @@ example_gl2_cube_render (GtkEglImageWidget *ewidget)
     glVertex3f ( 1.f,-1.f, 1.f);
     glVertex3f ( 1.f,-1.f,-1.f);
   glEnd ();
-  glFinish ();
-
-  image = eglCreateImage (cube->display,
-                          cube->context,
-                          EGL_GL_TEXTURE_2D,
-                          (EGLClientBuffer) (GLintptr) tex,
-                          NULL);
 
-  glBindTexture (GL_TEXTURE_2D, 0);
-  glDeleteTextures (1, &tex);
-
-  if (image == EGL_NO_IMAGE)
-    gtk_egl_image_widget_set_last_egl_error (GTK_EGL_IMAGE_WIDGET (cube), "eglCreateImage");
+  if (cube->sync_type)
+    sync = eglCreateSyncKHR (cube->display, cube->sync_type, NULL);
+  if (sync != EGL_NO_SYNC_KHR)
+    {
+      glFlush ();
+      gtk_egl_image_widget_set_render_sync (ewidget, sync);
+    }
+  else
+    glFinish ();
 
-  return image;
+  return target->image;
 }
 
 static void
-example_gl2_cube_realize (GtkWidget *widget)
+example_gl2_cube_ready (GtkEglImageWidget *ewidget)
 {
-  ExampleGl2Cube *cube = EXAMPLE_GL2_CUBE (widget);
+  ExampleGl2Cube *cube = EXAMPLE_GL2_CUBE (ewidget);
   EGLConfig config;
   EGLint num_configs;
 
@@ -163,8 +152,6 @@ example_gl2_cube_realize (GtkWidget *widget)
     EGL_NONE,
   };
 
-  GTK_WIDGET_CLASS (example_gl2_cube_parent_class)->realize (widget);
-
   cube->display = gtk_egl_image_widget_get_egl_display (GTK_EGL_IMAGE_WIDGET (cube));
   if (!cube->display)
     return;
@@ -195,12 +182,12 @@ example_gl2_cube_realize (GtkWidget *widget)
       return;
     }
 
-  glGenFramebuffers (1, &cube->fb);
   glGenRenderbuffers (1, &cube->rb);
 
-  glBindFramebuffer (GL_FRAMEBUFFER, cube->fb);
-  glBindRenderbuffer (GL_RENDERBUFFER, cube->rb);
-  glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, cube->rb);
+  if (epoxy_has_egl_extension (cube->display, "EGL_ANDROID_native_fence_sync"))
+    cube->sync_type = EGL_SYNC_NATIVE_FENCE_ANDROID;
+  else if (epoxy_has_egl_extension (cube->display, "EGL_KHR_fence_sync"))
+    cube->sync_type = EGL_SYNC_FENCE_KHR;
 
   glClearColor (0.0f, 0.0f, 0.0f, 0.0f);
   glClearDepth (1.0);
@@ -214,15 +201,16 @@ example_gl2_cube_unrealize (GtkWidget *widget)
 {
   ExampleGl2Cube *cube = EXAMPLE_GL2_CUBE (widget);
 
-  if (eglMakeCurrent (cube->display, EGL_NO_SURFACE, EGL_NO_SURFACE, cube->context))
+  if (cube->context != EGL_NO_CONTEXT)
     {
-      if (cube->fb)
-        glDeleteFramebuffers (1, &cube->fb);
-      if (cube->rb)
+      if (cube->rb
+          && eglMakeCurrent (cube->display, EGL_NO_SURFACE, EGL_NO_SURFACE, cube->context))
         glDeleteRenderbuffers (1, &cube->rb);
+      eglMakeCurrent (cube->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+      eglDestroyContext (cube->display, cube->context);
+      cube->context = EGL_NO_CONTEXT;
+      cube->rb = 0;
     }
-  if (cube->context != EGL_NO_CONTEXT)
-    eglDestroyContext (cube->display, cube->context);
 
   GTK_WIDGET_CLASS (example_gl2_cube_parent_class)->unrealize (widget);
 }
@@ -235,8 +223,8 @@ example_gl2_cube_class_init (ExampleGl2CubeClass *class)
 
   ei_class->render = example_gl2_cube_render;
   ei_class->resize = example_gl2_cube_resize;
+  ei_class->ready = example_gl2_cube_ready;
 
-  widget_class->realize = example_gl2_cube_realize;
   widget_class->unrealize = example_gl2_cube_unrealize;
 }
 
@@ -251,7 +239,7 @@ build_ui (GtkApplication *app)
 
   window = gtk_application_window_new (app);
   gtk_window_set_default_size (GTK_WINDOW (window), 400, 400);
-  cube = g_object_new (EXAMPLE_TYPE_GL2_CUBE, NULL);
+  cube = g_object_new (EXAMPLE_TYPE_GL2_CUBE, "async-realize", TRUE, NULL);
   gtk_window_set_child (GTK_WINDOW (window), cube);
   gtk_window_present (GTK_WINDOW (window));
 }
@@ -0,0 +1,248 @@
+#include "gtkeglimagerendergroupprivate.h"
+#include "gtkeglimagewidgetprivate.h"
+
+struct _GtkEglImageRenderGroup
+{
+  GObject      parent_instance;
+
+  GPtrArray   *pending;
+  GHashTable  *members;
+  GHashTable  *clocks;
+  GHashTable  *contexts;
+  guint        n_batches;
+  guint        n_frames;
+};
+
+G_DEFINE_TYPE (GtkEglImageRenderGroup, gtk_egl_image_render_group, G_TYPE_OBJECT)
+
+static void
+disconnect_clock (gpointer key, gpointer value, gpointer user_data)
+{
+  g_signal_handler_disconnect (key, GPOINTER_TO_UINT (value));
+}
+
+static gboolean
+has_value (gpointer key, gpointer value, gpointer user_data)
+{
+  return value == user_data;
+}
+
+static void
+context_finalized (gpointer data, GObject *where_the_object_was)
+{
+  GtkEglImageRenderGroup *group = data;
+
+  g_hash_table_foreach_remove (group->contexts, has_value, where_the_object_was);
+}
+
+static void
+unwatch_context (gpointer key, gpointer value, gpointer user_data)
+{
+  g_object_weak_unref (value, context_finalized, user_data);
+}
+
+static void
+gtk_egl_image_render_group_dispose (GObject *object)
+{
+  GtkEglImageRenderGroup *group = GTK_EGL_IMAGE_RENDER_GROUP (object);
+
+  g_hash_table_remove_all (group->members);
+  g_hash_table_foreach (group->clocks, disconnect_clock, NULL);
+  g_hash_table_remove_all (group->clocks);
+  g_hash_table_foreach (group->contexts, unwatch_context, group);
+  g_hash_table_remove_all (group->contexts);
+  g_ptr_array_set_size (group->pending, 0);
+
+  G_OBJECT_CLASS (gtk_egl_image_render_group_parent_class)->dispose (object);
+}
+
+static void
+gtk_egl_image_render_group_finalize (GObject *object)
+{
+  GtkEglImageRenderGroup *group = GTK_EGL_IMAGE_RENDER_GROUP (object);
+
+  g_hash_table_unref (group->contexts);
+  g_hash_table_unref (group->clocks);
+  g_hash_table_unref (group->members);
+  g_ptr_array_unref (group->pending);
+
+  G_OBJECT_CLASS (gtk_egl_image_render_group_parent_class)->finalize (object);
+}
+
+static void
+gtk_egl_image_render_group_class_init (GtkEglImageRenderGroupClass *class)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+  object_class->dispose = gtk_egl_image_render_group_dispose;
+  object_class->finalize = gtk_egl_image_render_group_finalize;
+}
+
+static void
+gtk_egl_image_render_group_init (GtkEglImageRenderGroup *group)
+{
+  group->pending = g_ptr_array_new_with_free_func (g_object_unref);
+  group->members = g_hash_table_new_full (NULL, NULL, NULL, g_object_unref);
+  group->clocks = g_hash_table_new_full (NULL, NULL, g_object_unref, NULL);
+  group->contexts = g_hash_table_new (NULL, NULL);
+}
+
+GtkEglImageRenderGroup *
+gtk_egl_image_render_group_new (void)
+{
+  return g_object_new (GTK_TYPE_EGL_IMAGE_RENDER_GROUP, NULL);
+}
+
+static void
+render_batch (GtkEglImageRenderGroup *group, GPtrArray *batch)
+{
+  GtkEglImageWidget *first = g_ptr_array_index (batch, 0);
+  guint i;
+
+  /* render every member before importing any of them, so producers run
+   * back to back and the imports share the group's context */
+  gtk_egl_image_widget_clear_current (first);
+  for (i = 0; i < batch->len;)
+    {
+      if (gtk_egl_image_widget_batch_render (g_ptr_array_index (batch, i)))
+        i++;
+      else
+        g_ptr_array_remove_index (batch, i);
+    }
+
+  for (i = 0; i < batch->len; i++)
+    gtk_egl_image_widget_batch_import (g_ptr_array_index (batch, i));
+  gtk_egl_image_widget_batch_flush (first);
+
+  group->n_batches++;
+  group->n_frames += batch->len;
+}
+
+static void
+clock_layout (GdkFrameClock *clock, gpointer user_data)
+{
+  GtkEglImageRenderGroup *group = GTK_EGL_IMAGE_RENDER_GROUP (user_data);
+  g_autoptr (GPtrArray) batch = g_ptr_array_new_with_free_func (g_object_unref);
+
+  g_object_ref (clock);
+  g_object_ref (group);
+
+  for (guint i = 0; i < group->pending->len;)
+    {
+      GtkWidget *widget = g_ptr_array_index (group->pending, i);
+
+      if (gtk_widget_get_frame_clock (widget) == clock)
+        g_ptr_array_add (batch, g_ptr_array_steal_index (group->pending, i));
+      else
+        i++;
+    }
+
+  if (batch->len > 0)
+    render_batch (group, batch);
+
+  g_object_unref (group);
+  g_object_unref (clock);
+}
+
+/* the layout handler stays connected for as long as any member is on
+ * the clock, rather than being reconnected on every frame */
+static void
+remove_member (GtkEglImageRenderGroup *group, GtkEglImageWidget *ewidget)
+{
+  GdkFrameClock *clock;
+  gpointer handler_id;
+
+  if (!g_hash_table_steal_extended (group->members, ewidget, NULL, (gpointer *) &clock))
+    return;
+
+  if (!g_hash_table_find (group->members, has_value, clock)
+      && g_hash_table_lookup_extended (group->clocks, clock, NULL, &handler_id))
+    {
+      g_signal_handler_disconnect (clock, GPOINTER_TO_UINT (handler_id));
+      g_hash_table_remove (group->clocks, clock);
+    }
+
+  g_object_unref (clock);
+}
+
+void
+gtk_egl_image_render_group_queue (GtkEglImageRenderGroup *group,
+                                  GtkEglImageWidget      *ewidget)
+{
+  GdkFrameClock *clock = gtk_widget_get_frame_clock (GTK_WIDGET (ewidget));
+
+  if (clock == NULL)
+    return;
+
+  if (!g_ptr_array_find (group->pending, ewidget, NULL))
+    g_ptr_array_add (group->pending, g_object_ref (ewidget));
+
+  if (g_hash_table_lookup (group->members, ewidget) != clock)
+    {
+      remove_member (group, ewidget);
+      g_hash_table_insert (group->members, ewidget, g_object_ref (clock));
+    }
+
+  if (!g_hash_table_contains (group->clocks, clock))
+    {
+      gulong handler_id = g_signal_connect_after (clock, "layout",
+                                                  G_CALLBACK (clock_layout), group);
+
+      g_hash_table_insert (group->clocks, g_object_ref (clock), GUINT_TO_POINTER (handler_id));
+    }
+
+  /* a draw only requests the paint phase */
+  gdk_frame_clock_request_phase (clock, GDK_FRAME_CLOCK_PHASE_LAYOUT);
+}
+
+void
+gtk_egl_image_render_group_cancel (GtkEglImageRenderGroup *group,
+                                   GtkEglImageWidget      *ewidget)
+{
+  g_ptr_array_remove (group->pending, ewidget);
+  remove_member (group, ewidget);
+}
+
+/* members hold the context, the group only finds it for the next one on
+ * the same surface */
+GdkGLContext *
+gtk_egl_image_render_group_get_context (GtkEglImageRenderGroup *group,
+                                        GdkSurface             *surface)
+{
+  GdkGLContext *context = g_hash_table_lookup (group->contexts, surface);
+
+  if (context)
+    return g_object_ref (context);
+
+  context = gdk_surface_create_gl_context (surface, NULL);
+  if (context == NULL)
+    return NULL;
+
+  gdk_gl_context_set_forward_compatible (context, GL_TRUE);
+  if (!gdk_gl_context_realize (context, NULL))
+    {
+      g_object_unref (context);
+      return NULL;
+    }
+
+  g_object_weak_ref (G_OBJECT (context), context_finalized, group);
+  g_hash_table_insert (group->contexts, surface, context);
+
+  return context;
+}
+
+guint
+gtk_egl_image_render_group_get_n_batches (GtkEglImageRenderGroup *group)
+{
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_RENDER_GROUP (group), 0);
+
+  return group->n_batches;
+}
+
+guint
+gtk_egl_image_render_group_get_n_frames (GtkEglImageRenderGroup *group)
+{
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_RENDER_GROUP (group), 0);
+
+  return group->n_frames;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <gtk/gtk.h>
+
+#define GTK_TYPE_EGL_IMAGE_RENDER_GROUP (gtk_egl_image_render_group_get_type ())
+G_DECLARE_FINAL_TYPE (GtkEglImageRenderGroup, gtk_egl_image_render_group, GTK, EGL_IMAGE_RENDER_GROUP, GObject)
+
+GtkEglImageRenderGroup *gtk_egl_image_render_group_new          (void);
+guint                   gtk_egl_image_render_group_get_n_batches (GtkEglImageRenderGroup *group);
+guint                   gtk_egl_image_render_group_get_n_frames  (GtkEglImageRenderGroup *group);
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "gtkeglimagerendergroup.h"
+#include "gtkeglimagewidget.h"
+
+void          gtk_egl_image_render_group_queue       (GtkEglImageRenderGroup *group,
+                                                      GtkEglImageWidget      *ewidget);
+void          gtk_egl_image_render_group_cancel      (GtkEglImageRenderGroup *group,
+                                                      GtkEglImageWidget      *ewidget);
+GdkGLContext *gtk_egl_image_render_group_get_context (GtkEglImageRenderGroup *group,
+                                                      GdkSurface             *surface);
@@ -5,39 +5,192 @@
 #include <gdk/wayland/gdkwayland.h>
 #include <gdk/x11/gdkx.h>
 #include <gtk/gtk.h>
+#include <linux/dma-buf.h>
+#include <math.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <xcb/dri3.h>
 #include <xcb/glx.h>
 
-#include "gtkeglimagewidget.h"
+#ifdef HAVE_SYSPROF
+#include <sysprof-capture.h>
+#endif
+
+#include "gtkeglimagerendergroupprivate.h"
+#include "gtkeglimagewidgetprivate.h"
+#include "gtkeglimagewidgetstatsprivate.h"
+
+typedef struct _Frame Frame;
+typedef struct _BufferPool BufferPool;
+typedef struct _SharedDisplay SharedDisplay;
+typedef struct _RenderTargetGarbage RenderTargetGarbage;
+
+typedef struct
+{
+  guint32 fourcc;
+  guint64 modifier;
+} DrmFormat;
+
+#ifdef HAVE_SYSPROF
+#define PROFILER_CURRENT_TIME SYSPROF_CAPTURE_CURRENT_TIME
+#define profiler_add_mark(begin, name, message) \
+  sysprof_collector_mark ((begin), SYSPROF_CAPTURE_CURRENT_TIME - (begin), "EglImageWidget", (name), (message))
+#else
+#define PROFILER_CURRENT_TIME 0
+#define profiler_add_mark(begin, name, message) G_STMT_START { (void) (begin); } G_STMT_END
+#endif
+
+#define READBACK_SLOTS 3
+
+#define GPU_TIMER_QUERIES 4
+
+#define DYNAMIC_SCALE_MIN           0.25
+#define DYNAMIC_SCALE_SETTLE_FRAMES 30
+
+typedef struct
+{
+  GLuint                   pbo;
+  GLsync                   fence;
+  gsize                    size;
+  int                      width;
+  int                      height;
+  cairo_region_t          *region;
+  struct _EGLTextureData  *image_data;
+} ReadbackSlot;
 
 typedef struct
 {
   EGLDisplay     display;
   EGLint         platform;
   EGLContext     egl_context;
+  SharedDisplay *shared;
   struct {
     Display     *display;
-    GLXFBConfig  fb_config;
     int          screen;
-    int          fb_depth;
+    GPtrArray   *pixmap_cache;
   } x11;
   GdkGLContext  *gdk_context;
+  GdkGLContext  *group_context;
   EGLenum        gdk_api;
   GdkTexture    *texture;
+  GPtrArray     *render_targets;
+  RenderTargetGarbage *target_garbage;
+  guint          n_render_targets;
+  guint          max_frames_in_flight;
+  GtkEglImageFramePolicy frame_policy;
+  int            render_width;
+  int            render_height;
+  EGLSyncKHR     render_sync;
+  cairo_region_t *render_damage;
+  gboolean       render_static;
+  GError        *render_error;
+  struct {
+    GtkEglImageReleaseFunc func;
+    gpointer     data;
+  } render_release;
+  struct {
+    ReadbackSlot slots[READBACK_SLOTS];
+    GLuint       fbo;
+    guint        head;
+    guint        n_pending;
+    GBytes      *last_bytes;
+    int          last_width;
+    int          last_height;
+  } readback;
+  BufferPool    *buffer_pool;
+  GArray        *formats;
+  struct {
+    GPtrArray   *targets;
+    GLuint       program;
+    GLuint       buffer;
+    GLuint       vertex_array;
+    GLenum       texture_target;
+  } yuv;
+  GtkEglImageWidgetStats *stats;
+  const char    *import_path;
+  GtkEglImageRenderGroup *render_group;
+  Frame         *batch_frame;
+  struct {
+    GLuint       queries[GPU_TIMER_QUERIES];
+    guint        head;
+    guint        n_pending;
+    gboolean     active;
+  } gpu_timer;
+  double         max_fps;
+  guint          resize_delay;
+  guint          resize_timeout_id;
+  GtkContentFit  content_fit;
+  int            content_width;
+  int            content_height;
+  double         render_scale;
+  double         frame_budget;
+  struct {
+    double       scale;
+    double       frame_time_avg;
+    gint64       frame_time;
+    guint        n_frames;
+  } dynamic;
+  guint          tick_id;
+  gint64         next_frame_time;
+  struct {
+    GThread     *thread;
+    GMutex       mutex;
+    GCond        cond;
+    GQueue       frames;
+    guint        max_frames;
+    GtkEglImageFramePolicy policy;
+    int          width;
+    int          height;
+    gboolean     render_requested;
+    gboolean     render_ahead;
+    gboolean     content_static;
+    gboolean     quit;
+  } thread;
   GError        *error;
   GtkWidget     *label;
-  GskGLShader   *swap_shader;
+  GtkWidget     *placeholder;
+  gboolean       ready: 1;
+  gboolean       async_realize: 1;
+  gboolean       allow_mmap: 1;
+  gboolean       share_context: 1;
+  gboolean       owns_egl_context: 1;
+  gboolean       batching: 1;
   gboolean       needs_resize: 1;
   gboolean       needs_render: 1;
   gboolean       auto_render: 1;
+  gboolean       content_static: 1;
+  gboolean       dynamic_resolution: 1;
+  gboolean       threaded: 1;
   gboolean       swap_rb: 1;
   gboolean       is_glx: 1;
   gboolean       owned_display: 1;
+  gboolean       has_wait_sync: 1;
+  gboolean       has_native_fence: 1;
+  gboolean       has_dmabuf_export: 1;
+  gboolean       use_dmabuf_texture: 1;
+  gboolean       timer_query_checked: 1;
+  gboolean       has_timer_query: 1;
 } GtkEglImageWidgetPrivate;
 
 enum {
   PROP_0,
   PROP_AUTO_RENDER,
+  PROP_N_RENDER_TARGETS,
+  PROP_THREADED,
+  PROP_MAX_FPS,
+  PROP_RESIZE_DELAY,
+  PROP_CONTENT_FIT,
+  PROP_DYNAMIC_RESOLUTION,
+  PROP_FRAME_BUDGET,
+  PROP_RENDER_SCALE,
+  PROP_ASYNC_REALIZE,
+  PROP_RENDER_GROUP,
+  PROP_MAX_FRAMES_IN_FLIGHT,
+  PROP_FRAME_POLICY,
+  PROP_ALLOW_MMAP,
+  PROP_SHARE_CONTEXT,
   LAST_PROP
 };
 
@@ -46,6 +199,7 @@ static GParamSpec *props[LAST_PROP] = { NULL, };
 enum {
   RENDER,
   RESIZE,
+  READY,
 
   LAST_SIGNAL
 };
@@ -54,904 +208,4679 @@ static guint signals[LAST_SIGNAL] = { 0, };
 
 G_DEFINE_TYPE_WITH_PRIVATE (GtkEglImageWidget, gtk_egl_image_widget, GTK_TYPE_WIDGET);
 
+G_DEFINE_ENUM_TYPE (GtkEglImageFramePolicy, gtk_egl_image_frame_policy,
+  G_DEFINE_ENUM_VALUE (GTK_EGL_IMAGE_FRAME_POLICY_MAILBOX, "mailbox"),
+  G_DEFINE_ENUM_VALUE (GTK_EGL_IMAGE_FRAME_POLICY_FIFO, "fifo"))
+
 static const char *
 egl_error_str (void);
 
+static void
+readback_clear (GtkEglImageWidget *ewidget);
+
+static void
+gpu_timer_clear (GtkEglImageWidget *ewidget);
+
+static void
+start_render_thread (GtkEglImageWidget *ewidget);
+
+static void
+update_render_scheduler (GtkEglImageWidget *ewidget);
+
+static void
+set_content_static (GtkEglImageWidget *ewidget, gboolean content_static);
+
+static SharedDisplay *
+shared_display_ref (SharedDisplay *shared);
+
+static void
+shared_display_release (SharedDisplay *shared);
+
+static void
+yuv_converter_clear (GtkEglImageWidget *ewidget);
+
+#define BUFFER_POOL_MAX_FREE 4
+
+struct _BufferPool
+{
+  gatomicrefcount ref_count;
+  GMutex          mutex;
+  gsize           buffer_size;
+  GPtrArray      *free_buffers;
+  guint64         hits;
+  guint64         misses;
+};
+
+typedef struct
+{
+  BufferPool *pool;
+  gpointer    data;
+  gsize       size;
+} PoolBuffer;
+
+static BufferPool *
+buffer_pool_new (void)
+{
+  BufferPool *pool = g_new0 (BufferPool, 1);
+
+  g_atomic_ref_count_init (&pool->ref_count);
+  g_mutex_init (&pool->mutex);
+  pool->free_buffers = g_ptr_array_new_with_free_func (g_free);
+
+  return pool;
+}
+
+static void
+buffer_pool_unref (BufferPool *pool)
+{
+  if (!g_atomic_ref_count_dec (&pool->ref_count))
+    return;
+
+  g_ptr_array_unref (pool->free_buffers);
+  g_mutex_clear (&pool->mutex);
+  g_free (pool);
+}
+
+static void
+buffer_pool_trim (BufferPool *pool)
+{
+  g_mutex_lock (&pool->mutex);
+  g_ptr_array_set_size (pool->free_buffers, 0);
+  g_mutex_unlock (&pool->mutex);
+}
+
+static PoolBuffer *
+buffer_pool_acquire (BufferPool *pool, gsize size)
+{
+  PoolBuffer *buffer = g_new0 (PoolBuffer, 1);
+
+  g_mutex_lock (&pool->mutex);
+  if (pool->buffer_size != size)
+    {
+      g_ptr_array_set_size (pool->free_buffers, 0);
+      pool->buffer_size = size;
+    }
+  if (pool->free_buffers->len > 0)
+    {
+      buffer->data = g_ptr_array_steal_index_fast (pool->free_buffers,
+                                                   pool->free_buffers->len - 1);
+      pool->hits++;
+    }
+  else
+    {
+      buffer->data = g_malloc (size);
+      pool->misses++;
+    }
+  g_mutex_unlock (&pool->mutex);
+
+  g_atomic_ref_count_inc (&pool->ref_count);
+  buffer->pool = pool;
+  buffer->size = size;
+
+  return buffer;
+}
+
+static void
+pool_buffer_release (gpointer data)
+{
+  PoolBuffer *buffer = data;
+  BufferPool *pool = buffer->pool;
+
+  g_mutex_lock (&pool->mutex);
+  if (buffer->size == pool->buffer_size && pool->free_buffers->len < BUFFER_POOL_MAX_FREE)
+    g_ptr_array_add (pool->free_buffers, g_steal_pointer (&buffer->data));
+  g_mutex_unlock (&pool->mutex);
+
+  g_free (buffer->data);
+  g_free (buffer);
+  buffer_pool_unref (pool);
+}
+
+static GBytes *
+pool_buffer_to_bytes (PoolBuffer *buffer)
+{
+  return g_bytes_new_with_free_func (buffer->data, buffer->size, pool_buffer_release, buffer);
+}
+
 static void
 gtk_egl_image_widget_init (GtkEglImageWidget *ewidget)
 {
   GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
   priv->auto_render = TRUE;
+  priv->allow_mmap = TRUE;
+  priv->share_context = TRUE;
   priv->needs_render = TRUE;
+  priv->n_render_targets = 3;
+  priv->max_frames_in_flight = 1;
+  priv->frame_policy = GTK_EGL_IMAGE_FRAME_POLICY_MAILBOX;
+  priv->content_fit = GTK_CONTENT_FIT_FILL;
+  priv->dynamic.scale = 1.0;
+  g_mutex_init (&priv->thread.mutex);
+  g_cond_init (&priv->thread.cond);
+  priv->buffer_pool = buffer_pool_new ();
+  priv->stats = gtk_egl_image_widget_stats_new ();
 }
 
+/* What this thread last made current through the widget. Anything that
+ * can switch contexts behind our back (producer signal handlers, texture
+ * release callbacks, GTK itself between frames) invalidates it, after
+ * which the next transition is always performed. */
 typedef struct
 {
-  EGLDisplay display;
-  EGLContext context;
-  EGLImage   image;
-} EGLTextureData;
+  gboolean      known;
+  EGLDisplay    display;
+  EGLContext    egl_context;
+  GdkGLContext *gdk_context;
+  EGLenum       api;
+} ContextState;
 
-static void
-free_egl_texture_data (gpointer data)
+static GPrivate context_state_key = G_PRIVATE_INIT (g_free);
+
+static ContextState *
+context_state_get (void)
 {
-  EGLTextureData *tdata = data;
+  ContextState *state = g_private_get (&context_state_key);
 
-  if (tdata->image != EGL_NO_IMAGE
-      && (tdata->context == EGL_NO_CONTEXT
-        || eglMakeCurrent (tdata->display, EGL_NO_SURFACE, EGL_NO_SURFACE, tdata->context)))
-    eglDestroyImage (tdata->display, tdata->image);
-  g_free (tdata);
+  if (state == NULL)
+    {
+      state = g_new0 (ContextState, 1);
+      g_private_set (&context_state_key, state);
+    }
+
+  return state;
 }
 
-static inline EGLDisplay
-get_egl_display (EGLenum platform, gpointer native_display)
+static void
+context_state_invalidate (void)
 {
-  if (epoxy_has_egl_extension (NULL, "EGL_EXT_platform_base"))
-    return eglGetPlatformDisplayEXT (platform, native_display, NULL);
-  if (epoxy_has_egl_extension (NULL, "EGL_KHR_platform_base"))
-    return eglGetPlatformDisplay (platform, native_display, NULL);
-  return eglGetDisplay (native_display);
+  context_state_get ()->known = FALSE;
 }
 
-static inline Bool
-check_dri3_version (Display *disp)
+enum {
+  TARGET_FREE,
+  TARGET_ACQUIRED,
+  TARGET_PRESENTED,
+};
+
+typedef struct
 {
-  int op, ev, err;
-  xcb_connection_t *conn;
-  g_autofree xcb_dri3_query_version_reply_t *reply = NULL;
+  EGLContext context;
+  GLuint     texture;
+  GLuint     framebuffer;
+} OrphanedTarget;
 
-  if (!XQueryExtension (disp, "DRI3", &op, &ev, &err))
-    return False;
+/* GL objects of slots dropped while their context was current on
+ * another thread, deleted by whoever next has that context current */
+struct _RenderTargetGarbage
+{
+  gatomicrefcount ref_count;
+  GMutex          mutex;
+  GArray         *targets;
+};
 
-  conn = XGetXCBConnection (disp);
-  reply = xcb_dri3_query_version_reply (
-      conn, xcb_dri3_query_version_unchecked (conn, 1, 2), NULL);
-  if (!reply || reply->major_version < 1
-      || (reply->major_version == 1 && reply->minor_version < 2))
-    return False;
+static RenderTargetGarbage *
+render_target_garbage_new (void)
+{
+  RenderTargetGarbage *garbage = g_new0 (RenderTargetGarbage, 1);
 
-  return True;
+  g_atomic_ref_count_init (&garbage->ref_count);
+  g_mutex_init (&garbage->mutex);
+  garbage->targets = g_array_new (FALSE, FALSE, sizeof (OrphanedTarget));
+
+  return garbage;
 }
 
-static const char SWAP_SRC[] = "\
-uniform sampler2D u_texture1;\n\
-void mainImage(out vec4 fragColor, in vec2 fragCoord, in vec2 resolution, in vec2 uv)\n\
-{\n\
-  fragColor = GskTexture(u_texture1, uv).bgra;\n\
-}\
-";
+static RenderTargetGarbage *
+render_target_garbage_ref (RenderTargetGarbage *garbage)
+{
+  g_atomic_ref_count_inc (&garbage->ref_count);
+  return garbage;
+}
 
-static inline void
-find_display (GtkEglImageWidget *ewidget)
+static void
+render_target_garbage_unref (RenderTargetGarbage *garbage)
 {
-  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
-  GdkDisplay *gdk_display = gtk_widget_get_display (GTK_WIDGET (ewidget));
-  EGLDisplay tmp_display;
-  int major, minor;
+  if (!g_atomic_ref_count_dec (&garbage->ref_count))
+    return;
 
-  if (GDK_IS_WAYLAND_DISPLAY (gdk_display))
+  g_array_unref (garbage->targets);
+  g_mutex_clear (&garbage->mutex);
+  g_free (garbage);
+}
+
+/* deletes what belongs to the current context */
+static void
+render_target_garbage_collect (RenderTargetGarbage *garbage)
+{
+  EGLContext context = eglGetCurrentContext ();
+
+  g_mutex_lock (&garbage->mutex);
+  for (guint i = 0; i < garbage->targets->len;)
     {
-      priv->display = gdk_wayland_display_get_egl_display (gdk_display);
-      if (priv->display == EGL_NO_DISPLAY
-          && (epoxy_has_egl_extension (NULL, "EGL_EXT_platform_wayland")
-            || epoxy_has_egl_extension (NULL, "EGL_KHR_platform_wayland")))
+      OrphanedTarget *target = &g_array_index (garbage->targets, OrphanedTarget, i);
+
+      if (target->context != context)
         {
-          tmp_display = get_egl_display (EGL_PLATFORM_WAYLAND_EXT,
-                                         gdk_wayland_display_get_wl_display (gdk_display));
-          if (tmp_display && eglInitialize (tmp_display, &major, &minor)
-              && (major > 1 || (major == 1 && minor >= 4)))
-            {
-              priv->display = tmp_display;
-              priv->owned_display = TRUE;
-            }
+          i++;
+          continue;
         }
-      if (priv->display)
-        priv->platform = EGL_PLATFORM_WAYLAND_EXT;
+      glDeleteFramebuffers (1, &target->framebuffer);
+      glDeleteTextures (1, &target->texture);
+      g_array_remove_index_fast (garbage->targets, i);
     }
-  else if (GDK_IS_X11_DISPLAY (gdk_display))
+  g_mutex_unlock (&garbage->mutex);
+}
+
+/* once no thread renders any more; contexts that cannot be made
+ * current by now have taken their objects with them */
+static void
+render_target_garbage_flush (RenderTargetGarbage *garbage, EGLDisplay display)
+{
+  g_mutex_lock (&garbage->mutex);
+  for (guint i = 0; i < garbage->targets->len; i++)
     {
-      priv->display = gdk_x11_display_get_egl_display (gdk_display);
-      if (priv->display == EGL_NO_DISPLAY)
-        {
-          Display *x11_display = gdk_x11_display_get_xdisplay (gdk_display);
+      OrphanedTarget *target = &g_array_index (garbage->targets, OrphanedTarget, i);
 
-          if (epoxy_has_egl_extension (NULL, "EGL_EXT_platform_x11")
-              || epoxy_has_egl_extension (NULL, "EGL_KHR_platform_x11"))
-            {
-              tmp_display = get_egl_display (EGL_PLATFORM_X11_EXT, x11_display);
-              if (tmp_display && eglInitialize (tmp_display, &major, &minor)
-                  && (major > 1 || (major == 1 && minor >= 4)))
-                {
-                  priv->display = tmp_display;
-                  priv->owned_display = TRUE;
-                }
-            }
+      if (eglMakeCurrent (display, EGL_NO_SURFACE, EGL_NO_SURFACE, target->context))
+        {
+          glDeleteFramebuffers (1, &target->framebuffer);
+          glDeleteTextures (1, &target->texture);
         }
-      if (priv->display != EGL_NO_DISPLAY)
-        priv->platform = EGL_PLATFORM_X11_EXT;
     }
+  if (garbage->targets->len > 0)
+    {
+      eglMakeCurrent (display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+      context_state_invalidate ();
+    }
+  g_array_set_size (garbage->targets, 0);
+  g_mutex_unlock (&garbage->mutex);
+}
+
+typedef struct
+{
+  GtkEglImageRenderTarget target;
+  gatomicrefcount         ref_count;
+  int                     state;
+  EGLDisplay              display;
+  EGLContext              context;
+  RenderTargetGarbage    *garbage;
+} RenderTargetSlot;
+
+static RenderTargetSlot *
+render_target_slot_ref (RenderTargetSlot *slot)
+{
+  g_atomic_ref_count_inc (&slot->ref_count);
+  return slot;
+}
+
+static void
+render_target_slot_unref (gpointer data)
+{
+  RenderTargetSlot *slot = data;
+  EGLDisplay prev_display;
+  EGLContext prev_context;
+  EGLSurface prev_draw, prev_read;
+
+  if (!g_atomic_ref_count_dec (&slot->ref_count))
+    return;
+
+  if (slot->target.image != EGL_NO_IMAGE)
+    eglDestroyImage (slot->display, slot->target.image);
 
-  if (priv->display == EGL_NO_DISPLAY)
+  prev_display = eglGetCurrentDisplay ();
+  prev_context = eglGetCurrentContext ();
+  prev_draw = eglGetCurrentSurface (EGL_DRAW);
+  prev_read = eglGetCurrentSurface (EGL_READ);
+
+  /* the GL objects live in the producer's context; if that is gone
+   * they are reclaimed along with it, if it is current on another
+   * thread that thread deletes them on its next acquire */
+  if (prev_context != slot->context
+      && !eglMakeCurrent (slot->display, EGL_NO_SURFACE, EGL_NO_SURFACE, slot->context))
     {
-      if (epoxy_has_egl_extension (NULL, "EGL_MESA_platform_surfaceless"))
+      if (eglGetError () == EGL_BAD_ACCESS)
         {
-          tmp_display = eglGetPlatformDisplay (EGL_PLATFORM_SURFACELESS_MESA, NULL, NULL);
-          if (tmp_display && eglInitialize (tmp_display, &major, &minor)
-              && (major > 1 || (major == 1 && minor >= 4)))
-            {
-              priv->display = tmp_display;
-              priv->platform = EGL_PLATFORM_SURFACELESS_MESA;
-              priv->owned_display = TRUE;
-            }
+          OrphanedTarget target = { slot->context, slot->target.texture, slot->target.framebuffer };
+
+          g_mutex_lock (&slot->garbage->mutex);
+          g_array_append_val (slot->garbage->targets, target);
+          g_mutex_unlock (&slot->garbage->mutex);
         }
-      else if (epoxy_has_egl_extension (NULL, "EGL_KHR_platform_gbm")
-          || epoxy_has_egl_extension (NULL, "EGL_MESA_platform_gbm"))
+    }
+  else
+    {
+      glDeleteFramebuffers (1, &slot->target.framebuffer);
+      glDeleteTextures (1, &slot->target.texture);
+
+      if (prev_context != slot->context)
         {
-          tmp_display = eglGetPlatformDisplayEXT (EGL_PLATFORM_GBM_KHR, NULL, NULL);
-          if (tmp_display && eglInitialize (tmp_display, &major, &minor)
-              && (major > 1 || (major == 1 && minor >= 4)))
-            {
-              priv->display = tmp_display;
-              priv->platform = EGL_PLATFORM_GBM_KHR;
-              priv->owned_display = TRUE;
-            }
+          if (prev_context != EGL_NO_CONTEXT)
+            eglMakeCurrent (prev_display, prev_draw, prev_read, prev_context);
+          else
+            eglMakeCurrent (slot->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+          context_state_invalidate ();
         }
     }
 
-  if (priv->display != EGL_NO_DISPLAY && GDK_IS_X11_DISPLAY (gdk_display)
-      && priv->owned_display)
+  g_clear_pointer (&slot->garbage, render_target_garbage_unref);
+  g_free (slot);
+}
+
+static RenderTargetSlot *
+find_render_target (GtkEglImageWidget *ewidget, EGLImage image)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  if (priv->render_targets == NULL)
+    return NULL;
+
+  for (guint i = 0; i < priv->render_targets->len; i++)
     {
-      Display *x11_display = gdk_x11_display_get_xdisplay (gdk_display);
-      GdkX11Screen *screen = gdk_x11_display_get_screen (gdk_display);
-      int screen_num = gdk_x11_screen_get_screen_number (screen);
-
-      if (gdk_x11_display_get_glx_version (gdk_display, &major, &minor)
-          && (major > 1 || (major == 1 && minor >= 3))
-          && epoxy_has_egl_extension (priv->display, "EGL_MESA_image_dma_buf_export")
-          && epoxy_has_glx_extension (x11_display, screen_num,
-                                      "GLX_EXT_texture_from_pixmap")
-          && check_dri3_version (x11_display))
-        {
-          g_autoptr (GBytes) bytes = g_bytes_new_static (SWAP_SRC, sizeof SWAP_SRC);
+      RenderTargetSlot *slot = g_ptr_array_index (priv->render_targets, i);
 
-          priv->is_glx = TRUE;
-          priv->x11.display = x11_display;
-          priv->x11.screen = screen_num;
-          priv->swap_shader = gsk_gl_shader_new_from_bytes (bytes);
-        }
+      if (slot->target.image == image)
+        return slot;
+    }
+
+  return NULL;
+}
+
+static void
+settle_render_targets (GtkEglImageWidget *ewidget, EGLImage image)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  if (priv->render_targets == NULL)
+    return;
+
+  for (guint i = 0; i < priv->render_targets->len; i++)
+    {
+      RenderTargetSlot *slot = g_ptr_array_index (priv->render_targets, i);
+
+      if (g_atomic_int_get (&slot->state) != TARGET_ACQUIRED)
+        continue;
+      if (image != EGL_NO_IMAGE && slot->target.image == image)
+        g_atomic_int_set (&slot->state, TARGET_PRESENTED);
       else
-        g_clear_object (&priv->gdk_context);
+        g_atomic_int_set (&slot->state, TARGET_FREE);
     }
 }
 
-static inline void
-clear_current_internal (GtkEglImageWidget *ewidget)
+static void
+render_target_release (EGLImage image, gpointer user_data)
+{
+  RenderTargetSlot *slot = user_data;
+
+  g_atomic_int_set (&slot->state, TARGET_FREE);
+  render_target_slot_unref (slot);
+}
+
+/* one image being rendered, the queued ones, one on screen and those
+ * the readback ring still reads from */
+static guint
+min_render_targets (GtkEglImageWidget *ewidget)
 {
   GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-  if (priv->gdk_context)
-      gdk_gl_context_clear_current ();
-    eglMakeCurrent (priv->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
-    if (priv->gdk_api)
-      eglBindAPI (priv->gdk_api);
+  return priv->max_frames_in_flight + 2 + READBACK_SLOTS;
 }
 
-static inline EGLBoolean
-make_current_internal (GtkEglImageWidget *ewidget)
+/* takes a free slot of @pool matching @context and size, or creates one
+ * unless @pool already holds @n_targets */
+static RenderTargetSlot *
+render_target_pool_acquire (GtkEglImageWidget  *ewidget,
+                            GPtrArray         **pool,
+                            guint               n_targets,
+                            EGLContext          context,
+                            int                 width,
+                            int                 height)
 {
   GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  RenderTargetSlot *slot;
+  GLint old_texture, old_framebuffer;
+  guint i = 0;
 
-  g_assert (priv->gdk_context || priv->egl_context != EGL_NO_CONTEXT);
+  if (priv->target_garbage == NULL)
+    priv->target_garbage = render_target_garbage_new ();
+  render_target_garbage_collect (priv->target_garbage);
 
-  clear_current_internal (ewidget);
+  if (*pool == NULL)
+    *pool = g_ptr_array_new_with_free_func (render_target_slot_unref);
+  if ((*pool)->len > n_targets)
+    g_ptr_array_remove_range (*pool, n_targets, (*pool)->len - n_targets);
 
-  if (priv->gdk_context && !priv->is_glx)
+  while (i < (*pool)->len)
     {
-      if (priv->gdk_api)
-        eglBindAPI (priv->gdk_api);
-      gdk_gl_context_make_current (priv->gdk_context);
-      return EGL_TRUE;
-    }
+      slot = g_ptr_array_index (*pool, i);
 
-  if (!eglMakeCurrent (priv->display, EGL_NO_SURFACE, EGL_NO_SURFACE, priv->egl_context))
-    {
-      gtk_egl_image_widget_set_last_egl_error (ewidget, "eglMakeCurrent");
-      return EGL_FALSE;
+      if (slot->context != context
+          || slot->target.width != width
+          || slot->target.height != height)
+        {
+          g_ptr_array_remove_index (*pool, i);
+          continue;
+        }
+      if (g_atomic_int_compare_and_exchange (&slot->state, TARGET_FREE, TARGET_ACQUIRED))
+        return slot;
+      i++;
     }
 
-  if (!eglBindAPI (EGL_OPENGL_API))
+  if ((*pool)->len >= n_targets)
+    return NULL;
+
+  slot = g_new0 (RenderTargetSlot, 1);
+  g_atomic_ref_count_init (&slot->ref_count);
+  slot->state = TARGET_ACQUIRED;
+  slot->display = priv->display;
+  slot->context = context;
+  slot->garbage = render_target_garbage_ref (priv->target_garbage);
+  slot->target.width = width;
+  slot->target.height = height;
+
+  glGetIntegerv (GL_TEXTURE_BINDING_2D, &old_texture);
+  glGenTextures (1, &slot->target.texture);
+  glBindTexture (GL_TEXTURE_2D, slot->target.texture);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, slot->target.width, slot->target.height,
+                0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glBindTexture (GL_TEXTURE_2D, old_texture);
+
+  glGetIntegerv (GL_FRAMEBUFFER_BINDING, &old_framebuffer);
+  glGenFramebuffers (1, &slot->target.framebuffer);
+  glBindFramebuffer (GL_FRAMEBUFFER, slot->target.framebuffer);
+  glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                          slot->target.texture, 0);
+  glBindFramebuffer (GL_FRAMEBUFFER, old_framebuffer);
+
+  slot->target.image = eglCreateImage (priv->display, context, EGL_GL_TEXTURE_2D,
+                                       (EGLClientBuffer) (GLintptr) slot->target.texture,
+                                       NULL);
+  if (slot->target.image == EGL_NO_IMAGE)
     {
-      gtk_egl_image_widget_set_last_egl_error (ewidget, "eglBindAPI");
-      return EGL_FALSE;
+      gtk_egl_image_widget_set_last_egl_error (ewidget, "eglCreateImage");
+      render_target_slot_unref (slot);
+      return NULL;
     }
 
-  return EGL_TRUE;
+  g_ptr_array_add (*pool, slot);
+  gtk_egl_image_widget_stats_add_allocation (priv->stats);
+
+  return slot;
 }
 
-static inline EGLContext
-create_rgba_context (GtkEglImageWidget *ewidget)
+typedef struct _EGLTextureData
 {
-  const GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
-  EGLConfig config;
-  EGLint num_configs;
-  EGLContext context = EGL_NO_CONTEXT;
-  const EGLint config_attribs[] = {
-    EGL_RED_SIZE,             8,
-    EGL_GREEN_SIZE,           8,
-    EGL_BLUE_SIZE,            8,
-    EGL_ALPHA_SIZE,           8,
-    EGL_NONE,
-  };
-  const EGLint ctx_attribs[] = {
-    EGL_CONTEXT_CLIENT_VERSION, 3,
-    EGL_NONE,
-  };
-
-  g_assert (priv->display != EGL_NO_DISPLAY);
+  SharedDisplay          *shared;
+  EGLDisplay              display;
+  EGLContext              context;
+  EGLImage                image;
+  GtkEglImageReleaseFunc  release_func;
+  gpointer                release_data;
+} EGLTextureData;
 
-  if (!eglChooseConfig (priv->display, config_attribs, &config, 1, &num_configs))
+static EGLTextureData *
+egl_texture_data_new (GtkEglImageWidget *ewidget, EGLImage image)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  EGLTextureData *tdata = g_new0 (EGLTextureData, 1);
+  RenderTargetSlot *slot;
+
+  tdata->shared = shared_display_ref (priv->shared);
+  tdata->display = priv->display;
+  tdata->context = priv->egl_context;
+  tdata->image = image;
+  if (priv->render_release.func)
     {
-      gtk_egl_image_widget_set_last_egl_error (ewidget, "eglGetConfigs");
-      return EGL_NO_CONTEXT;
+      tdata->release_func = g_steal_pointer (&priv->render_release.func);
+      tdata->release_data = g_steal_pointer (&priv->render_release.data);
     }
-  if (num_configs < 1)
+  else if ((slot = find_render_target (ewidget, image)) != NULL)
     {
-      gtk_egl_image_widget_set_error_literal (ewidget, "No valid EGL configs");
-      return EGL_NO_CONTEXT;
+      tdata->release_func = render_target_release;
+      tdata->release_data = render_target_slot_ref (slot);
     }
-  context = eglCreateContext (priv->display, config, EGL_NO_CONTEXT, ctx_attribs);
-  if (context == EGL_NO_CONTEXT)
-    {
-      gtk_egl_image_widget_set_last_egl_error (ewidget, "eglCreateContext");
-      return EGL_NO_CONTEXT;
-    }
-  return context;
+
+  return tdata;
 }
 
 static void
-gtk_egl_image_widget_realize (GtkWidget *widget)
+free_egl_texture_data (gpointer data)
 {
-  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (widget);
-  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
-  GdkSurface *surface;
-  gboolean has_oes_egl_image;
+  EGLTextureData *tdata = data;
+  gint64 begin_time = PROFILER_CURRENT_TIME;
 
-  g_clear_error (&priv->error);
+  if (tdata->release_func)
+    tdata->release_func (tdata->image, tdata->release_data);
+  else if (tdata->image != EGL_NO_IMAGE
+      && (tdata->context == EGL_NO_CONTEXT
+        || eglMakeCurrent (tdata->display, EGL_NO_SURFACE, EGL_NO_SURFACE, tdata->context)))
+    {
+      eglDestroyImage (tdata->display, tdata->image);
+      if (tdata->context != EGL_NO_CONTEXT)
+        context_state_invalidate ();
+    }
+  /* the images must not outlive their display */
+  g_clear_pointer (&tdata->shared, shared_display_release);
+  g_free (tdata);
 
-  GTK_WIDGET_CLASS (gtk_egl_image_widget_parent_class)->realize (widget);
+  profiler_add_mark (begin_time, "release", NULL);
+}
 
-  surface = gtk_native_get_surface (GTK_NATIVE (gtk_widget_get_root (widget)));
-  g_set_object (&priv->gdk_context, gdk_surface_create_gl_context (surface, NULL));
+struct _Frame
+{
+  EGLTextureData *image_data;
+  EGLDisplay      display;
+  EGLSyncKHR      sync;
+  cairo_region_t *damage;
+  GError         *error;
+  gint64          render_time;
+  int             width;
+  int             height;
+  gboolean        content_static;
+};
 
-  if (priv->gdk_context)
-    {
-      gdk_gl_context_set_forward_compatible (priv->gdk_context, GL_TRUE);
-      if (!gdk_gl_context_realize (priv->gdk_context, NULL))
-        goto error;
-      priv->gdk_api = eglQueryAPI ();
-    }
+static void
+frame_merge_damage (Frame *frame, const Frame *dropped)
+{
+  if (frame->damage == NULL)
+    return;
+  if (dropped->damage == NULL)
+    g_clear_pointer (&frame->damage, cairo_region_destroy);
+  else
+    cairo_region_union (frame->damage, dropped->damage);
+}
 
-  find_display (ewidget);
+static void
+frame_free (Frame *frame)
+{
+  g_clear_pointer (&frame->damage, cairo_region_destroy);
+  if (frame->sync != EGL_NO_SYNC_KHR)
+    eglDestroySyncKHR (frame->display, frame->sync);
+  if (frame->image_data)
+    free_egl_texture_data (frame->image_data);
+  g_clear_error (&frame->error);
+  g_free (frame);
+}
 
-  if (priv->display == EGL_NO_DISPLAY)
-    {
-      gtk_egl_image_widget_set_error_literal (ewidget,
-                                          "Could not create EGLDisplay for %s",
-                                          G_OBJECT_TYPE_NAME (gtk_widget_get_display (widget)));
-      goto error;
-    }
+/* the producer's context may be current on another thread, and
+ * eglDestroyImage does not need it */
+static void
+frame_drop (Frame *frame, Frame *next)
+{
+  frame_merge_damage (next, frame);
+  frame->image_data->context = EGL_NO_CONTEXT;
+  frame_free (frame);
+}
 
-  if (!priv->gdk_context || priv->is_glx)
-    {
-      priv->egl_context = create_rgba_context (ewidget);
-      if (priv->egl_context == EGL_NO_CONTEXT)
-        goto error;
-    }
+static inline EGLDisplay
+get_egl_display (EGLenum platform, gpointer native_display)
+{
+  if (epoxy_has_egl_extension (NULL, "EGL_EXT_platform_base"))
+    return eglGetPlatformDisplayEXT (platform, native_display, NULL);
+  if (epoxy_has_egl_extension (NULL, "EGL_KHR_platform_base"))
+    return eglGetPlatformDisplay (platform, native_display, NULL);
+  return eglGetDisplay (native_display);
+}
 
-  if (!make_current_internal (ewidget))
-    goto error;
+static inline Bool
+check_dri3_version (Display *disp)
+{
+  int op, ev, err;
+  xcb_connection_t *conn;
+  g_autofree xcb_dri3_query_version_reply_t *reply = NULL;
 
-  has_oes_egl_image = epoxy_has_gl_extension ("GL_OES_EGL_image");
+  if (!XQueryExtension (disp, "DRI3", &op, &ev, &err))
+    return False;
 
-  clear_current_internal (ewidget);
+  conn = XGetXCBConnection (disp);
+  reply = xcb_dri3_query_version_reply (
+      conn, xcb_dri3_query_version_unchecked (conn, 1, 2), NULL);
+  if (!reply || reply->major_version < 1
+      || (reply->major_version == 1 && reply->minor_version < 2))
+    return False;
 
-  if (!has_oes_egl_image)
+  return True;
+}
+
+static const char SWAP_SRC[] = "\
+uniform sampler2D u_texture1;\n\
+void mainImage(out vec4 fragColor, in vec2 fragCoord, in vec2 resolution, in vec2 uv)\n\
+{\n\
+  fragColor = GskTexture(u_texture1, uv).bgra;\n\
+}\
+";
+
+static GskGLShader *
+get_swap_shader (void)
+{
+  static GskGLShader *swap_shader = NULL;
+
+  if (g_once_init_enter (&swap_shader))
     {
-      gtk_egl_image_widget_set_error_literal (ewidget, "Missing extension: GL_OES_EGL_image");
-      goto error;
-    }
+      g_autoptr (GBytes) bytes = g_bytes_new_static (SWAP_SRC, sizeof SWAP_SRC);
 
-  priv->needs_resize = TRUE;
+      g_once_init_leave (&swap_shader, gsk_gl_shader_new_from_bytes (bytes));
+    }
 
-  return;
-error:
-  g_signal_stop_emission_by_name (ewidget, "realize");
+  return swap_shader;
 }
 
-static void
-gtk_egl_image_widget_unrealize (GtkWidget *widget)
+#define SHARED_DISPLAY_KEY "gtk-egl-image-widget-shared-display"
+#define SHARED_DISPLAY_MAX_FB_CONFIGS 4
+
+/* EGL state that every widget on a GdkDisplay can use */
+struct _SharedDisplay
 {
-  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (widget);
-  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
-  GtkWidget *child;
+  gatomicrefcount ref_count;
+  GdkDisplay  *gdk_display;
+  EGLenum      native_platform;
+  gpointer     native_display;
+  EGLDisplay   display;
+  EGLint       platform;
+  EGLContext   context;
+  Display     *x11_display;
+  int          x11_screen;
+  struct {
+    int          depth;
+    GLXFBConfig  config;
+  } fb_configs[SHARED_DISPLAY_MAX_FB_CONFIGS];
+  guint        n_fb_configs;
+  GPtrArray   *waiters;
+  gboolean     initialized;
+  gboolean     initializing;
+  gboolean     want_context;
+  gboolean     has_glx_1_3: 1;
+  gboolean     owned_display: 1;
+  gboolean     terminate_display: 1;
+  gboolean     is_glx: 1;
+  gboolean     has_wait_sync: 1;
+  gboolean     has_native_fence: 1;
+  gboolean     has_dmabuf_export: 1;
+};
 
-  g_clear_object (&priv->gdk_context);
-  g_clear_object (&priv->texture);
-  g_clear_object (&priv->swap_shader);
-  g_clear_error (&priv->error);
-  priv->platform = EGL_FALSE;
-  priv->gdk_api = EGL_FALSE;
-  priv->label = NULL;
-  priv->swap_rb = FALSE;
-  priv->is_glx = FALSE;
-  priv->owned_display = FALSE;
+static gboolean
+gtk_egl_image_widget_finish_realize (GtkEglImageWidget *ewidget);
 
-  while ((child = gtk_widget_get_first_child (widget)) != NULL)
-    gtk_widget_unparent (child);
+/* @initialized tells whether this call initialized the display, rather
+ * than someone else on the same native display, GDK included */
+static EGLDisplay
+initialize_display (EGLenum platform, gpointer native_display, gboolean *initialized)
+{
+  EGLDisplay display;
+  int major, minor;
 
-  GTK_WIDGET_CLASS (gtk_egl_image_widget_parent_class)->unrealize (widget);
+  if (platform == EGL_PLATFORM_SURFACELESS_MESA)
+    display = eglGetPlatformDisplay (platform, native_display, NULL);
+  else if (platform == EGL_PLATFORM_GBM_KHR)
+    display = eglGetPlatformDisplayEXT (platform, native_display, NULL);
+  else
+    display = get_egl_display (platform, native_display);
 
-  if (priv->display)
-    {
-      if (priv->egl_context != EGL_NO_CONTEXT)
-        {
-          eglDestroyContext (priv->display, priv->egl_context);
-          priv->egl_context = EGL_NO_CONTEXT;
-        }
-      if (priv->owned_display)
-        eglTerminate (priv->display);
-      if (priv->platform == EGL_PLATFORM_X11_EXT)
-        memset (&priv->x11, 0, sizeof priv->x11);
-    }
-  priv->display = EGL_NO_DISPLAY;
+  *initialized = display && eglQueryString (display, EGL_VENDOR) == NULL;
+  if (display && eglInitialize (display, &major, &minor)
+      && (major > 1 || (major == 1 && minor >= 4)))
+    return display;
+
+  return EGL_NO_DISPLAY;
 }
 
+/* everything that has to ask GDK, so it runs on the main thread */
 static void
-gtk_egl_image_widget_size_allocate (GtkWidget *widget,
-                                    int        width,
-                                    int        height,
-                                    int        baseline)
+shared_display_query_gdk (SharedDisplay *shared, GdkDisplay *gdk_display)
 {
-  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (widget);
-  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
-  GtkWidget *child = gtk_widget_get_first_child (widget);
+  int major, minor;
 
-  if (child)
+  if (GDK_IS_WAYLAND_DISPLAY (gdk_display))
     {
-      gtk_widget_measure (child, GTK_ORIENTATION_HORIZONTAL, width, NULL, NULL, NULL, NULL);
-      gtk_widget_size_allocate (child, &(GtkAllocation) { 0, 0, width, height }, baseline);
+      shared->display = gdk_wayland_display_get_egl_display (gdk_display);
+      if (shared->display != EGL_NO_DISPLAY)
+        shared->platform = EGL_PLATFORM_WAYLAND_EXT;
+      else if (epoxy_has_egl_extension (NULL, "EGL_EXT_platform_wayland")
+               || epoxy_has_egl_extension (NULL, "EGL_KHR_platform_wayland"))
+        {
+          shared->native_platform = EGL_PLATFORM_WAYLAND_EXT;
+          shared->native_display = gdk_wayland_display_get_wl_display (gdk_display);
+        }
     }
+  else if (GDK_IS_X11_DISPLAY (gdk_display))
+    {
+      Display *x11_display = gdk_x11_display_get_xdisplay (gdk_display);
+      GdkX11Screen *screen = gdk_x11_display_get_screen (gdk_display);
+
+      shared->display = gdk_x11_display_get_egl_display (gdk_display);
+      if (shared->display != EGL_NO_DISPLAY)
+        shared->platform = EGL_PLATFORM_X11_EXT;
+      else if (epoxy_has_egl_extension (NULL, "EGL_EXT_platform_x11")
+               || epoxy_has_egl_extension (NULL, "EGL_KHR_platform_x11"))
+        {
+          shared->native_platform = EGL_PLATFORM_X11_EXT;
+          shared->native_display = x11_display;
+        }
 
-  if (gtk_widget_get_realized (widget))
-    priv->needs_resize = TRUE;
+      shared->x11_display = x11_display;
+      shared->x11_screen = gdk_x11_screen_get_screen_number (screen);
+      shared->has_glx_1_3 = gdk_x11_display_get_glx_version (gdk_display, &major, &minor)
+                            && (major > 1 || (major == 1 && minor >= 3));
+    }
 }
 
-static gboolean
-queue_alloc (gpointer user_data)
+static const EGLint rgba_config_attribs[] = {
+  EGL_RED_SIZE,             8,
+  EGL_GREEN_SIZE,           8,
+  EGL_BLUE_SIZE,            8,
+  EGL_ALPHA_SIZE,           8,
+  EGL_NONE,
+};
+
+static const EGLint rgba_context_attribs[] = {
+  EGL_CONTEXT_CLIENT_VERSION, 3,
+  EGL_NONE,
+};
+
+static EGLContext
+shared_display_create_context (SharedDisplay *shared, EGLConfig config)
 {
-  gtk_widget_queue_allocate (GTK_WIDGET (user_data));
-  return FALSE;
+  if (shared->context == EGL_NO_CONTEXT)
+    shared->context = eglCreateContext (shared->display, config, EGL_NO_CONTEXT,
+                                        rgba_context_attribs);
+
+  return shared->context;
 }
 
-typedef struct
+/* opening our own EGLDisplay on GDK's Xlib connection, and the GLX and
+ * DRI3 probes that come with it, must stay on the main thread; GDK's own
+ * EGLDisplay is already initialized and needs none of that */
+static gboolean
+shared_display_needs_xlib (SharedDisplay *shared)
 {
-  xcb_connection_t *conn;
-  Display *display;
-  Pixmap pixmap;
-  GLXPixmap glxpixmap;
-} GLXTextureData;
+  return shared->x11_display != NULL && shared->display == EGL_NO_DISPLAY;
+}
 
+/* only touches Xlib when shared_display_needs_xlib(), otherwise safe to
+ * run on any thread */
 static void
-free_glx_texture_data (gpointer data)
+shared_display_initialize (SharedDisplay *shared)
 {
-  GLXTextureData *tdata = data;
+  gboolean initialized = FALSE;
 
-  glXReleaseTexImageEXT (tdata->display, tdata->glxpixmap, GLX_FRONT_LEFT_EXT);
-  glXDestroyGLXPixmap (tdata->display, tdata->glxpixmap);
-  xcb_free_pixmap (tdata->conn, tdata->pixmap);
-  g_free (tdata);
-}
+  if (shared->display == EGL_NO_DISPLAY && shared->native_platform)
+    {
+      shared->display = initialize_display (shared->native_platform, shared->native_display,
+                                            &initialized);
+      if (shared->display != EGL_NO_DISPLAY)
+        {
+          shared->platform = shared->native_platform;
+          shared->owned_display = TRUE;
+          shared->terminate_display = initialized;
+        }
+    }
 
-static uint32_t
-depth_for_format (uint32_t format)
-{
-  switch (format)
+  if (shared->display == EGL_NO_DISPLAY)
     {
-    case DRM_FORMAT_XRGB1555:
-    case DRM_FORMAT_XBGR1555:
-      return 15;
-    case DRM_FORMAT_RGB565:
-    case DRM_FORMAT_BGR565:
-      return 16;
-    case DRM_FORMAT_XRGB8888:
-    case DRM_FORMAT_XBGR8888:
-      return 24;
-    case DRM_FORMAT_XRGB2101010:
-    case DRM_FORMAT_XBGR2101010:
-      return 30;
-    case DRM_FORMAT_ARGB8888:
-    case DRM_FORMAT_ABGR8888:
-      return 32;
-    case DRM_FORMAT_ARGB16161616F:
-    case DRM_FORMAT_ABGR16161616F:
-      return 64;
-    default:
-      return 0;
+      if (epoxy_has_egl_extension (NULL, "EGL_MESA_platform_surfaceless"))
+        shared->platform = EGL_PLATFORM_SURFACELESS_MESA;
+      else if (epoxy_has_egl_extension (NULL, "EGL_KHR_platform_gbm")
+          || epoxy_has_egl_extension (NULL, "EGL_MESA_platform_gbm"))
+        shared->platform = EGL_PLATFORM_GBM_KHR;
+
+      if (shared->platform)
+        shared->display = initialize_display (shared->platform, NULL, &initialized);
+      shared->owned_display = shared->display != EGL_NO_DISPLAY;
+      shared->terminate_display = shared->owned_display && initialized;
     }
-}
 
-static uint32_t
-bpp_for_format (uint32_t format) {
-  switch (format)
+  if (shared->display == EGL_NO_DISPLAY)
     {
-    case DRM_FORMAT_XRGB1555:
-    case DRM_FORMAT_XBGR1555:
-    case DRM_FORMAT_RGB565:
-    case DRM_FORMAT_BGR565:
-      return 2;
-    case DRM_FORMAT_XRGB8888:
-    case DRM_FORMAT_XBGR8888:
-    case DRM_FORMAT_XRGB2101010:
-    case DRM_FORMAT_XBGR2101010:
-    case DRM_FORMAT_ARGB8888:
-    case DRM_FORMAT_ABGR8888:
-      return 4;
-    case DRM_FORMAT_ARGB16161616F:
-    case DRM_FORMAT_ABGR16161616F:
-      return 8;
-    default:
-      return 0;
+      shared->platform = EGL_FALSE;
+      return;
+    }
+
+  shared->has_wait_sync = epoxy_has_egl_extension (shared->display, "EGL_KHR_wait_sync");
+  shared->has_native_fence = epoxy_has_egl_extension (shared->display, "EGL_ANDROID_native_fence_sync");
+  shared->has_dmabuf_export = epoxy_has_egl_extension (shared->display, "EGL_MESA_image_dma_buf_export");
+
+  if (shared->x11_display && shared->owned_display)
+    shared->is_glx = shared->has_glx_1_3
+                     && shared->has_dmabuf_export
+                     && epoxy_has_glx_extension (shared->x11_display, shared->x11_screen,
+                                                 "GLX_EXT_texture_from_pixmap")
+                     && check_dri3_version (shared->x11_display);
+
+  if (shared->want_context || shared->is_glx)
+    {
+      EGLConfig config;
+      EGLint num_configs;
+
+      if (eglChooseConfig (shared->display, rgba_config_attribs, &config, 1, &num_configs)
+          && num_configs > 0)
+        shared_display_create_context (shared, config);
     }
 }
 
-static gboolean
-swapped_for_format (uint32_t format)
+static SharedDisplay *
+shared_display_acquire (GdkDisplay *gdk_display)
 {
-  switch (format)
+  SharedDisplay *shared = g_object_get_data (G_OBJECT (gdk_display), SHARED_DISPLAY_KEY);
+
+  if (shared)
     {
-    case DRM_FORMAT_XBGR1555:
-    case DRM_FORMAT_BGR565:
-    case DRM_FORMAT_XBGR8888:
-    case DRM_FORMAT_XBGR2101010:
-    case DRM_FORMAT_ABGR8888:
-    case DRM_FORMAT_ABGR16161616F:
-      return TRUE;
-    default:
-      return FALSE;
+      g_atomic_ref_count_inc (&shared->ref_count);
+      return shared;
     }
+
+  shared = g_new0 (SharedDisplay, 1);
+  g_atomic_ref_count_init (&shared->ref_count);
+  shared->gdk_display = gdk_display;
+  shared->context = EGL_NO_CONTEXT;
+  shared->waiters = g_ptr_array_new_with_free_func (g_object_unref);
+  shared_display_query_gdk (shared, gdk_display);
+
+  g_object_set_data (G_OBJECT (gdk_display), SHARED_DISPLAY_KEY, shared);
+
+  return shared;
+}
+
+static SharedDisplay *
+shared_display_ref (SharedDisplay *shared)
+{
+  g_atomic_ref_count_inc (&shared->ref_count);
+  return shared;
 }
 
 static void
-gtk_egl_image_widget_update_image_glx (GtkEglImageWidget *ewidget, EGLImage image)
+shared_display_release (SharedDisplay *shared)
 {
-  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
-  int width = gtk_widget_get_width (GTK_WIDGET (ewidget));
-  int height = gtk_widget_get_height (GTK_WIDGET (ewidget));
-  int fourcc, num_planes;
-  EGLuint64KHR modifiers;
-  int fds[4] = { -1, -1, -1, -1 };
-  EGLint strides[4] = { 0, };
-  EGLint offsets[4] = { 0, };
-  xcb_connection_t *conn;
-  GtkRoot *root;
-  GdkSurface *surface;
-  Window win;
-  guint depth, bpp;
-  Pixmap pixmap;
-  xcb_void_cookie_t cookie;
-  GLXPixmap glxpixmap;
-  GLXTextureData *texdata;
-  GLuint texid;
-  g_autoptr (GdkTexture) texture = NULL;
-  static const int pixmap_attribs[] = {
-    GLX_TEXTURE_TARGET_EXT, GLX_TEXTURE_2D_EXT,
-    GLX_TEXTURE_FORMAT_EXT, GLX_TEXTURE_FORMAT_RGBA_EXT,
-    None
+  if (!g_atomic_ref_count_dec (&shared->ref_count))
+    return;
+
+  g_object_set_data (G_OBJECT (shared->gdk_display), SHARED_DISPLAY_KEY, NULL);
+
+  /* the display may be GDK's, whose context must stay current */
+  if (shared->context != EGL_NO_CONTEXT)
+    {
+      if (eglGetCurrentContext () == shared->context)
+        {
+          eglMakeCurrent (shared->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+          context_state_invalidate ();
+        }
+      eglDestroyContext (shared->display, shared->context);
+    }
+  if (shared->terminate_display)
+    eglTerminate (shared->display);
+  g_ptr_array_unref (shared->waiters);
+  g_free (shared);
+}
+
+static void
+shared_display_complete (SharedDisplay *shared)
+{
+  g_autoptr (GPtrArray) waiters = g_steal_pointer (&shared->waiters);
+
+  shared->waiters = g_ptr_array_new_with_free_func (g_object_unref);
+  shared->initialized = TRUE;
+  shared->initializing = FALSE;
+
+  for (guint i = 0; i < waiters->len; i++)
+    gtk_egl_image_widget_finish_realize (g_ptr_array_index (waiters, i));
+}
+
+static void
+shared_display_init_thread (GTask        *task,
+                            gpointer      source_object,
+                            gpointer      task_data,
+                            GCancellable *cancellable)
+{
+  SharedDisplay *shared = task_data;
+
+  shared_display_initialize (shared);
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+shared_display_init_done (GObject      *source_object,
+                          GAsyncResult *result,
+                          gpointer      user_data)
+{
+  SharedDisplay *shared = g_task_get_task_data (G_TASK (result));
+
+  shared_display_complete (shared);
+}
+
+static void
+shared_display_init_async (SharedDisplay     *shared,
+                           GtkEglImageWidget *ewidget,
+                           gboolean           want_context)
+{
+  g_autoptr (GTask) task = NULL;
+
+  g_assert (!shared_display_needs_xlib (shared));
+
+  g_ptr_array_add (shared->waiters, g_object_ref (ewidget));
+
+  /* the worker reads these, later widgets create the context when they finish */
+  if (shared->initializing)
+    return;
+  shared->initializing = TRUE;
+  shared->want_context = want_context;
+
+  task = g_task_new (NULL, NULL, shared_display_init_done, NULL);
+  g_task_set_task_data (task, shared_display_ref (shared), (GDestroyNotify) shared_display_release);
+  g_task_run_in_thread (task, shared_display_init_thread);
+}
+
+static void
+shared_display_cancel_async (SharedDisplay *shared, GtkEglImageWidget *ewidget)
+{
+  g_ptr_array_remove (shared->waiters, ewidget);
+}
+
+static GLXFBConfig
+shared_display_get_fb_config (SharedDisplay *shared, int depth)
+{
+  GLXFBConfig *configs;
+  int num_configs;
+  GLXFBConfig config = NULL;
+  const int config_attribs[] = {
+      GLX_BIND_TO_TEXTURE_RGBA_EXT,    GL_TRUE,
+      GLX_BIND_TO_TEXTURE_TARGETS_EXT, GLX_TEXTURE_2D_BIT_EXT,
+      GLX_DOUBLEBUFFER,                GL_FALSE,
+      GLX_DRAWABLE_TYPE,               GLX_PIXMAP_BIT,
+      None
   };
 
-  if (!make_current_internal (ewidget))
+  for (guint i = 0; i < shared->n_fb_configs; i++)
+    if (shared->fb_configs[i].depth == depth)
+      return shared->fb_configs[i].config;
+
+  configs = glXChooseFBConfig (shared->x11_display, shared->x11_screen,
+                               config_attribs, &num_configs);
+
+  for (int i = 0; i < num_configs; i++)
+    {
+      GLXFBConfig c = configs[i];
+      XVisualInfo *visual = glXGetVisualFromFBConfig (shared->x11_display, c);
+      gboolean found = visual && visual->depth == depth;
+      XFree (visual);
+
+      if (!found)
+        continue;
+      config = c;
+      break;
+    }
+
+  XFree (configs);
+
+  if (config && shared->n_fb_configs < SHARED_DISPLAY_MAX_FB_CONFIGS)
+    {
+      shared->fb_configs[shared->n_fb_configs].depth = depth;
+      shared->fb_configs[shared->n_fb_configs].config = config;
+      shared->n_fb_configs++;
+    }
+
+  return config;
+}
+
+static inline gboolean
+context_state_skip (GtkEglImageWidget *ewidget, gboolean is_current)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  gtk_egl_image_widget_stats_add_context_switch (priv->stats, is_current);
+
+  return is_current;
+}
+
+static inline gboolean
+context_state_is_clear (GtkEglImageWidget *ewidget, ContextState *state)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  return state->known
+         && state->display == priv->display
+         && state->egl_context == EGL_NO_CONTEXT
+         && state->gdk_context == NULL
+         && (!priv->gdk_api || state->api == priv->gdk_api);
+}
+
+/* the release half of a transition, which the caller has counted */
+static inline void
+release_current (GtkEglImageWidget *ewidget, ContextState *state)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  if (priv->gdk_context)
+    gdk_gl_context_clear_current ();
+  eglMakeCurrent (priv->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (priv->gdk_api)
+    eglBindAPI (priv->gdk_api);
+
+  state->known = TRUE;
+  state->display = priv->display;
+  state->egl_context = EGL_NO_CONTEXT;
+  state->gdk_context = NULL;
+  state->api = priv->gdk_api;
+}
+
+static inline void
+clear_current_internal (GtkEglImageWidget *ewidget)
+{
+  ContextState *state = context_state_get ();
+
+  if (context_state_skip (ewidget, context_state_is_clear (ewidget, state)))
     return;
 
-  if (!eglExportDMABUFImageQueryMESA (priv->display, image, &fourcc, &num_planes, &modifiers))
+  release_current (ewidget, state);
+}
+
+/* grouped widgets import a batch through one context shared by every
+ * member on the surface, and everything else through their own */
+static inline GdkGLContext *
+import_context (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  if (priv->batching && priv->group_context)
+    return priv->group_context;
+
+  return priv->gdk_context;
+}
+
+static inline void
+make_gdk_current_internal (GtkEglImageWidget *ewidget, GdkGLContext *context)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  ContextState *state = context_state_get ();
+
+  if (context_state_skip (ewidget, state->known
+                                   && state->gdk_context == context
+                                   && state->api == priv->gdk_api))
+    return;
+
+  /* GDK replaces another of its own contexts by itself, so moving
+   * between two of them needs no release in between */
+  if ((!state->known || state->display != priv->display
+       || state->egl_context != EGL_NO_CONTEXT || state->gdk_context == NULL
+       || state->api != priv->gdk_api)
+      && !context_state_is_clear (ewidget, state))
+    release_current (ewidget, state);
+  gdk_gl_context_make_current (context);
+
+  state->gdk_context = context;
+}
+
+static inline EGLBoolean
+make_current_internal (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  ContextState *state = context_state_get ();
+
+  g_assert (priv->gdk_context || priv->egl_context != EGL_NO_CONTEXT);
+
+  if (priv->gdk_context && !priv->is_glx)
     {
-      gtk_egl_image_widget_set_last_egl_error (ewidget, "eglExportDMABUFImageQueryMESA");
-      return;
+      make_gdk_current_internal (ewidget, priv->gdk_context);
+      return EGL_TRUE;
     }
-  g_assert (num_planes >= 1 && num_planes <= 4);
-  depth = depth_for_format (fourcc);
-  bpp = bpp_for_format (fourcc) * 8;
 
-  if (!depth || !bpp)
+  if (context_state_skip (ewidget, state->known
+                                   && state->display == priv->display
+                                   && state->egl_context == priv->egl_context
+                                   && state->api == EGL_OPENGL_API))
+    return EGL_TRUE;
+
+  if (!context_state_is_clear (ewidget, state))
+    release_current (ewidget, state);
+
+  if (!eglMakeCurrent (priv->display, EGL_NO_SURFACE, EGL_NO_SURFACE, priv->egl_context))
     {
-      gtk_egl_image_widget_set_error_literal (
-          ewidget, "Unsupported DMABUF format 0x%08x for GLX import", fourcc);
-      return;
+      context_state_invalidate ();
+      gtk_egl_image_widget_set_last_egl_error (ewidget, "eglMakeCurrent");
+      return EGL_FALSE;
     }
+  state->egl_context = priv->egl_context;
 
-  if (!eglExportDMABUFImageMESA (priv->display, image, fds, strides, offsets))
+  if (!eglBindAPI (EGL_OPENGL_API))
     {
-      gtk_egl_image_widget_set_last_egl_error (ewidget, "eglExportDMABUFImageMESA");
-      return;
+      context_state_invalidate ();
+      gtk_egl_image_widget_set_last_egl_error (ewidget, "eglBindAPI");
+      return EGL_FALSE;
     }
+  state->api = EGL_OPENGL_API;
 
-  clear_current_internal (ewidget);
-  gdk_gl_context_make_current (priv->gdk_context);
+  return EGL_TRUE;
+}
 
-  conn = XGetXCBConnection (priv->x11.display);
-  root = gtk_widget_get_root (GTK_WIDGET (ewidget));
-  surface = gtk_native_get_surface (GTK_NATIVE (root));
-  win = gdk_x11_surface_get_xid (surface);
+static inline EGLContext
+create_rgba_context (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  EGLConfig config;
+  EGLint num_configs;
+  EGLContext context;
+
+  g_assert (priv->display != EGL_NO_DISPLAY);
+
+  if (!eglChooseConfig (priv->display, rgba_config_attribs, &config, 1, &num_configs))
+    {
+      gtk_egl_image_widget_set_last_egl_error (ewidget, "eglGetConfigs");
+      return EGL_NO_CONTEXT;
+    }
+  if (num_configs < 1)
+    {
+      gtk_egl_image_widget_set_error_literal (ewidget, "No valid EGL configs");
+      return EGL_NO_CONTEXT;
+    }
 
-  if (priv->x11.fb_config == NULL || depth != priv->x11.fb_depth)
+  /* a render thread would hold the shared context current against
+   * every other widget on the display */
+  priv->owns_egl_context = !priv->share_context || priv->threaded;
+  if (priv->owns_egl_context)
+    context = eglCreateContext (priv->display, config, EGL_NO_CONTEXT, rgba_context_attribs);
+  else
+    context = shared_display_create_context (priv->shared, config);
+  if (context == EGL_NO_CONTEXT)
     {
-      GLXFBConfig *configs;
-      int num_configs;
-      GLXFBConfig config = NULL;
-      const int config_attribs[] = {
-          GLX_BIND_TO_TEXTURE_RGBA_EXT,    GL_TRUE,
-          GLX_BIND_TO_TEXTURE_TARGETS_EXT, GLX_TEXTURE_2D_BIT_EXT,
-          GLX_DOUBLEBUFFER,                GL_FALSE,
-          GLX_DRAWABLE_TYPE,               GLX_PIXMAP_BIT,
-          None
-      };
+      gtk_egl_image_widget_set_last_egl_error (ewidget, "eglCreateContext");
+      return EGL_NO_CONTEXT;
+    }
 
-      configs = glXChooseFBConfig (priv->x11.display, priv->x11.screen,
-                                   config_attribs, &num_configs);
+  return context;
+}
 
-      for (int i = 0; i < num_configs; i++)
-        {
-          GLXFBConfig c = configs[i];
-          XVisualInfo *visual = glXGetVisualFromFBConfig (priv->x11.display, c);
-          gboolean found = visual && visual->depth == depth;
-          XFree (visual);
-
-          if (!found)
-            continue;
-          config = c;
-          break;
-        }
+static gboolean
+gtk_egl_image_widget_finish_realize (GtkEglImageWidget *ewidget)
+{
+  GtkWidget *widget = GTK_WIDGET (ewidget);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  gboolean has_oes_egl_image;
+
+  if (!gtk_widget_get_realized (widget) || priv->shared == NULL || priv->ready)
+    return FALSE;
+
+  if (priv->placeholder)
+    gtk_widget_unparent (g_steal_pointer (&priv->placeholder));
+
+  context_state_invalidate ();
 
-      XFree (configs);
+  if (priv->shared->display == EGL_NO_DISPLAY)
+    {
+      gtk_egl_image_widget_set_error_literal (ewidget,
+                                          "Could not create EGLDisplay for %s",
+                                          G_OBJECT_TYPE_NAME (gtk_widget_get_display (widget)));
+      return FALSE;
+    }
 
-      if (config == NULL)
+  priv->display = priv->shared->display;
+  priv->platform = priv->shared->platform;
+  priv->owned_display = priv->shared->owned_display;
+  if (priv->owned_display && GDK_IS_X11_DISPLAY (gtk_widget_get_display (widget)))
+    {
+      if (priv->shared->is_glx)
         {
-          gtk_egl_image_widget_set_error_literal (
-              ewidget, "No compatible GLXFBConfig found for depth %d", depth);
-          for (int i = 0; i < num_planes; i++)
-            if (fds[i] != -1)
-              close (fds[i]);
-          gdk_gl_context_clear_current ();
-          return;
+          priv->is_glx = TRUE;
+          priv->x11.display = priv->shared->x11_display;
+          priv->x11.screen = priv->shared->x11_screen;
         }
+      else
+        g_clear_object (&priv->gdk_context);
+    }
+
+  if (!priv->gdk_context || priv->is_glx)
+    {
+      priv->egl_context = create_rgba_context (ewidget);
+      if (priv->egl_context == EGL_NO_CONTEXT)
+        return FALSE;
+    }
+
+  if (!make_current_internal (ewidget))
+    return FALSE;
+
+  has_oes_egl_image = epoxy_has_gl_extension ("GL_OES_EGL_image");
+  priv->has_wait_sync = priv->shared->has_wait_sync;
+  priv->has_native_fence = priv->shared->has_native_fence;
+  priv->has_dmabuf_export = priv->shared->has_dmabuf_export;
+#if GTK_CHECK_VERSION (4, 14, 0)
+  priv->use_dmabuf_texture = priv->has_dmabuf_export
+    && gdk_dmabuf_formats_get_n_formats (gdk_display_get_dmabuf_formats (gtk_widget_get_display (widget))) > 0;
+#endif
+
+  clear_current_internal (ewidget);
 
-      priv->x11.fb_config = config;
-      priv->x11.fb_depth = depth;
+  if (!has_oes_egl_image)
+    {
+      gtk_egl_image_widget_set_error_literal (ewidget, "Missing extension: GL_OES_EGL_image");
+      return FALSE;
     }
 
-  pixmap = xcb_generate_id (conn);
+  priv->ready = TRUE;
+  priv->needs_resize = TRUE;
+  g_signal_emit (ewidget, signals[READY], 0);
+  context_state_invalidate ();
 
-  if ((modifiers != DRM_FORMAT_MOD_INVALID && modifiers != DRM_FORMAT_MOD_LINEAR) || num_planes > 1)
-    cookie =
-       xcb_dri3_pixmap_from_buffers_checked (conn, pixmap, win, num_planes,
-                                             width, height,
-                                             strides[0], offsets[0],
-                                             strides[1], offsets[1],
-                                             strides[2], offsets[2],
-                                             strides[3], offsets[3],
-                                             depth, bpp, modifiers, fds);
-  else
-    cookie =
-       xcb_dri3_pixmap_from_buffer_checked (conn, pixmap, win,
-                                            height * strides[0],
-                                            width, height, strides[0],
-                                            depth, bpp, fds[0]);
+  if (gtk_widget_get_mapped (widget))
+    {
+      if (priv->threaded && !priv->error)
+        start_render_thread (ewidget);
+      update_render_scheduler (ewidget);
+    }
+  gtk_widget_queue_draw (widget);
+
+  return TRUE;
+}
+
+static void
+gtk_egl_image_widget_realize (GtkWidget *widget)
+{
+  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (widget);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  GdkSurface *surface;
+
+  g_clear_error (&priv->error);
+
+  GTK_WIDGET_CLASS (gtk_egl_image_widget_parent_class)->realize (widget);
+
+  surface = gtk_native_get_surface (GTK_NATIVE (gtk_widget_get_root (widget)));
+  g_set_object (&priv->gdk_context, gdk_surface_create_gl_context (surface, NULL));
+
+  if (priv->gdk_context)
+    {
+      gdk_gl_context_set_forward_compatible (priv->gdk_context, GL_TRUE);
+      if (!gdk_gl_context_realize (priv->gdk_context, NULL))
+        goto error;
+      priv->gdk_api = eglQueryAPI ();
+    }
+
+  priv->shared = shared_display_acquire (gtk_widget_get_display (widget));
+
+  /* Xlib is not ours to use from another thread, so an X11 display
+   * without GDK's EGLDisplay realizes synchronously */
+  if (!priv->shared->initialized && !shared_display_needs_xlib (priv->shared)
+      && (priv->async_realize || priv->shared->initializing))
+    {
+      priv->placeholder = gtk_spinner_new ();
+      gtk_widget_set_halign (priv->placeholder, GTK_ALIGN_CENTER);
+      gtk_widget_set_valign (priv->placeholder, GTK_ALIGN_CENTER);
+      gtk_spinner_start (GTK_SPINNER (priv->placeholder));
+      gtk_widget_set_parent (priv->placeholder, widget);
+      shared_display_init_async (priv->shared, ewidget, priv->gdk_context == NULL);
+      return;
+    }
+
+  if (!priv->shared->initialized)
+    {
+      shared_display_initialize (priv->shared);
+      priv->shared->initialized = TRUE;
+    }
+
+  if (!gtk_egl_image_widget_finish_realize (ewidget))
+    goto error;
+
+  return;
+error:
+  g_signal_stop_emission_by_name (ewidget, "realize");
+}
+
+static void
+gtk_egl_image_widget_unrealize (GtkWidget *widget)
+{
+  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (widget);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  GtkWidget *child;
+
+  if (priv->shared && !priv->ready)
+    shared_display_cancel_async (priv->shared, ewidget);
+  if (priv->render_group)
+    gtk_egl_image_render_group_cancel (priv->render_group, ewidget);
+
+  if (priv->egl_context != EGL_NO_CONTEXT
+      && eglMakeCurrent (priv->display, EGL_NO_SURFACE, EGL_NO_SURFACE, priv->egl_context))
+    {
+      readback_clear (ewidget);
+      if (priv->gdk_context == NULL)
+        gpu_timer_clear (ewidget);
+      if (priv->gdk_context == NULL || priv->is_glx)
+        yuv_converter_clear (ewidget);
+      eglMakeCurrent (priv->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+  if (priv->gdk_context)
+    {
+      gdk_gl_context_make_current (priv->gdk_context);
+      gpu_timer_clear (ewidget);
+      if (!priv->is_glx)
+        yuv_converter_clear (ewidget);
+      gdk_gl_context_clear_current ();
+    }
+  context_state_invalidate ();
+
+  g_clear_object (&priv->gdk_context);
+  g_clear_object (&priv->group_context);
+  g_clear_object (&priv->texture);
+  g_clear_pointer (&priv->x11.pixmap_cache, g_ptr_array_unref);
+  g_clear_pointer (&priv->render_targets, g_ptr_array_unref);
+  g_clear_pointer (&priv->yuv.targets, g_ptr_array_unref);
+  memset (&priv->yuv, 0, sizeof priv->yuv);
+  if (priv->target_garbage)
+    render_target_garbage_flush (priv->target_garbage, priv->display);
+  g_clear_pointer (&priv->target_garbage, render_target_garbage_unref);
+  g_clear_pointer (&priv->formats, g_array_unref);
+  g_clear_error (&priv->error);
+  priv->platform = EGL_FALSE;
+  priv->gdk_api = EGL_FALSE;
+  priv->label = NULL;
+  priv->placeholder = NULL;
+  priv->import_path = NULL;
+  priv->ready = FALSE;
+  priv->swap_rb = FALSE;
+  priv->is_glx = FALSE;
+  priv->owned_display = FALSE;
+  priv->has_wait_sync = FALSE;
+  priv->has_native_fence = FALSE;
+  priv->has_dmabuf_export = FALSE;
+  priv->use_dmabuf_texture = FALSE;
+
+  while ((child = gtk_widget_get_first_child (widget)) != NULL)
+    gtk_widget_unparent (child);
+
+  GTK_WIDGET_CLASS (gtk_egl_image_widget_parent_class)->unrealize (widget);
+
+  g_clear_handle_id (&priv->resize_timeout_id, g_source_remove);
+  priv->content_width = priv->content_height = 0;
+
+  if (priv->display)
+    {
+      if (priv->render_sync != EGL_NO_SYNC_KHR)
+        eglDestroySyncKHR (priv->display, g_steal_pointer (&priv->render_sync));
+      g_clear_pointer (&priv->render_damage, cairo_region_destroy);
+      g_clear_error (&priv->render_error);
+      priv->render_static = FALSE;
+      if (priv->owns_egl_context && priv->egl_context != EGL_NO_CONTEXT)
+        eglDestroyContext (priv->display, priv->egl_context);
+      priv->egl_context = EGL_NO_CONTEXT;
+      priv->owns_egl_context = FALSE;
+      memset (&priv->x11, 0, sizeof priv->x11);
+    }
+  g_clear_pointer (&priv->shared, shared_display_release);
+  priv->display = EGL_NO_DISPLAY;
+}
+
+static gboolean
+resize_timeout (gpointer user_data)
+{
+  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (user_data);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  priv->resize_timeout_id = 0;
+  priv->needs_resize = TRUE;
+  gtk_widget_queue_draw (GTK_WIDGET (ewidget));
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+gtk_egl_image_widget_size_allocate (GtkWidget *widget,
+                                    int        width,
+                                    int        height,
+                                    int        baseline)
+{
+  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (widget);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  GtkWidget *child = gtk_widget_get_first_child (widget);
+
+  if (child)
+    {
+      gtk_widget_measure (child, GTK_ORIENTATION_HORIZONTAL, width, NULL, NULL, NULL, NULL);
+      gtk_widget_size_allocate (child, &(GtkAllocation) { 0, 0, width, height }, baseline);
+    }
+
+  if (!gtk_widget_get_realized (widget))
+    return;
+
+  if (priv->resize_delay == 0 || priv->texture == NULL)
+    {
+      g_clear_handle_id (&priv->resize_timeout_id, g_source_remove);
+      priv->needs_resize = TRUE;
+    }
+  else if (priv->resize_timeout_id != 0
+           || width != priv->content_width || height != priv->content_height)
+    {
+      g_clear_handle_id (&priv->resize_timeout_id, g_source_remove);
+      priv->resize_timeout_id = g_timeout_add (priv->resize_delay, resize_timeout, ewidget);
+    }
+}
+
+static gboolean
+queue_alloc (gpointer user_data)
+{
+  gtk_widget_queue_allocate (GTK_WIDGET (user_data));
+  return FALSE;
+}
+
+#define GLX_PIXMAP_CACHE_SIZE 8
+
+typedef struct
+{
+  gatomicrefcount   ref_count;
+  xcb_connection_t *conn;
+  Display          *display;
+  GdkGLContext     *context;
+  Pixmap            pixmap;
+  GLXPixmap         glxpixmap;
+  GLuint            texid;
+  ino_t             inode;
+  int               width;
+  int               height;
+  uint32_t          fourcc;
+  uint64_t          modifier;
+  gboolean          swizzled;
+} GLXPixmapCacheEntry;
+
+static GLXPixmapCacheEntry *
+glx_pixmap_cache_entry_ref (GLXPixmapCacheEntry *entry)
+{
+  g_atomic_ref_count_inc (&entry->ref_count);
+  return entry;
+}
+
+static void
+glx_pixmap_cache_entry_unref (gpointer data)
+{
+  GLXPixmapCacheEntry *entry = data;
+  GdkGLContext *prev_context;
+
+  if (!g_atomic_ref_count_dec (&entry->ref_count))
+    return;
+
+  prev_context = gdk_gl_context_get_current ();
+  if (prev_context != entry->context)
+    gdk_gl_context_make_current (entry->context);
+
+  glXReleaseTexImageEXT (entry->display, entry->glxpixmap, GLX_FRONT_LEFT_EXT);
+  glDeleteTextures (1, &entry->texid);
+  glXDestroyGLXPixmap (entry->display, entry->glxpixmap);
+  xcb_free_pixmap (entry->conn, entry->pixmap);
+
+  if (prev_context == NULL)
+    gdk_gl_context_clear_current ();
+  else if (prev_context != entry->context)
+    gdk_gl_context_make_current (prev_context);
+  context_state_invalidate ();
+
+  g_object_unref (entry->context);
+  g_free (entry);
+}
+
+static GLXPixmapCacheEntry *
+glx_pixmap_cache_lookup (GPtrArray *cache,
+                         ino_t      inode,
+                         int        width,
+                         int        height,
+                         uint32_t   fourcc,
+                         uint64_t   modifier)
+{
+  for (guint i = 0; i < cache->len; i++)
+    {
+      GLXPixmapCacheEntry *entry = g_ptr_array_index (cache, i);
+
+      if (entry->inode == inode && entry->width == width && entry->height == height
+          && entry->fourcc == fourcc && entry->modifier == modifier)
+        {
+          /* a GdkTexture still wraps this texture name, so rebinding it would
+           * change that texture under GDK; drop it and build a fresh one */
+          if (!g_atomic_ref_count_compare (&entry->ref_count, 1))
+            {
+              g_ptr_array_remove_index (cache, i);
+              return NULL;
+            }
+
+          /* keep the most recently used entries at the end */
+          g_ptr_array_add (cache, g_ptr_array_steal_index (cache, i));
+          return entry;
+        }
+    }
+
+  return NULL;
+}
+
+static void
+glx_pixmap_cache_evict_size (GPtrArray *cache, int width, int height)
+{
+  guint i = 0;
+
+  while (i < cache->len)
+    {
+      GLXPixmapCacheEntry *entry = g_ptr_array_index (cache, i);
+
+      if (entry->width != width || entry->height != height)
+        g_ptr_array_remove_index (cache, i);
+      else
+        i++;
+    }
+}
+
+typedef struct
+{
+  GLXPixmapCacheEntry *entry;
+  EGLTextureData      *image_data;
+} GLXTextureData;
+
+static void
+free_glx_texture_data (gpointer data)
+{
+  GLXTextureData *tdata = data;
+
+  glx_pixmap_cache_entry_unref (tdata->entry);
+  free_egl_texture_data (tdata->image_data);
+  g_free (tdata);
+}
+
+static GLXTextureData *
+glx_texture_data_new (GLXPixmapCacheEntry *entry, EGLTextureData *image_data)
+{
+  GLXTextureData *tdata = g_new0 (GLXTextureData, 1);
+
+  tdata->entry = glx_pixmap_cache_entry_ref (entry);
+  tdata->image_data = image_data;
+
+  return tdata;
+}
+
+static uint32_t
+depth_for_format (uint32_t format)
+{
+  switch (format)
+    {
+    case DRM_FORMAT_XRGB1555:
+    case DRM_FORMAT_XBGR1555:
+      return 15;
+    case DRM_FORMAT_RGB565:
+    case DRM_FORMAT_BGR565:
+      return 16;
+    case DRM_FORMAT_XRGB8888:
+    case DRM_FORMAT_XBGR8888:
+      return 24;
+    case DRM_FORMAT_XRGB2101010:
+    case DRM_FORMAT_XBGR2101010:
+      return 30;
+    case DRM_FORMAT_ARGB8888:
+    case DRM_FORMAT_ABGR8888:
+      return 32;
+    case DRM_FORMAT_ARGB16161616F:
+    case DRM_FORMAT_ABGR16161616F:
+      return 64;
+    default:
+      return 0;
+    }
+}
+
+static uint32_t
+bpp_for_format (uint32_t format) {
+  switch (format)
+    {
+    case DRM_FORMAT_XRGB1555:
+    case DRM_FORMAT_XBGR1555:
+    case DRM_FORMAT_RGB565:
+    case DRM_FORMAT_BGR565:
+      return 2;
+    case DRM_FORMAT_XRGB8888:
+    case DRM_FORMAT_XBGR8888:
+    case DRM_FORMAT_XRGB2101010:
+    case DRM_FORMAT_XBGR2101010:
+    case DRM_FORMAT_ARGB8888:
+    case DRM_FORMAT_ABGR8888:
+      return 4;
+    case DRM_FORMAT_ARGB16161616F:
+    case DRM_FORMAT_ABGR16161616F:
+      return 8;
+    default:
+      return 0;
+    }
+}
+
+static gboolean
+memory_format_for_format (uint32_t format, GdkMemoryFormat *memory_format)
+{
+  switch (format)
+    {
+    case DRM_FORMAT_ARGB8888:
+      *memory_format = GDK_MEMORY_B8G8R8A8;
+      return TRUE;
+    case DRM_FORMAT_ABGR8888:
+      *memory_format = GDK_MEMORY_R8G8B8A8;
+      return TRUE;
+#if GTK_CHECK_VERSION (4, 14, 0)
+    case DRM_FORMAT_XRGB8888:
+      *memory_format = GDK_MEMORY_B8G8R8X8;
+      return TRUE;
+    case DRM_FORMAT_XBGR8888:
+      *memory_format = GDK_MEMORY_R8G8B8X8;
+      return TRUE;
+#endif
+    case DRM_FORMAT_ABGR16161616F:
+      *memory_format = GDK_MEMORY_R16G16B16A16_FLOAT;
+      return TRUE;
+    default:
+      return FALSE;
+    }
+}
+
+static GdkTexture *
+gl_texture_new (GdkGLContext         *context,
+                GLuint                id,
+                int                   width,
+                int                   height,
+                GdkTexture           *update_texture,
+                const cairo_region_t *update_region,
+                GDestroyNotify        destroy,
+                gpointer              data)
+{
+#if GTK_CHECK_VERSION (4, 12, 0)
+  if (update_texture && update_region
+      && gdk_texture_get_width (update_texture) == width
+      && gdk_texture_get_height (update_texture) == height)
+    {
+      g_autoptr (GdkGLTextureBuilder) builder = gdk_gl_texture_builder_new ();
+
+      gdk_gl_texture_builder_set_context (builder, context);
+      gdk_gl_texture_builder_set_id (builder, id);
+      gdk_gl_texture_builder_set_width (builder, width);
+      gdk_gl_texture_builder_set_height (builder, height);
+      gdk_gl_texture_builder_set_update_texture (builder, update_texture);
+      gdk_gl_texture_builder_set_update_region (builder, (cairo_region_t *) update_region);
+
+      return gdk_gl_texture_builder_build (builder, destroy, data);
+    }
+#endif
+
+  return gdk_gl_texture_new (context, id, width, height, destroy, data);
+}
+
+static GdkTexture *
+memory_texture_new (int                   width,
+                    int                   height,
+                    GdkMemoryFormat       format,
+                    GBytes               *bytes,
+                    gsize                 stride,
+                    GdkTexture           *update_texture,
+                    const cairo_region_t *update_region)
+{
+#if GTK_CHECK_VERSION (4, 16, 0)
+  if (update_texture && update_region
+      && gdk_texture_get_width (update_texture) == width
+      && gdk_texture_get_height (update_texture) == height)
+    {
+      g_autoptr (GdkMemoryTextureBuilder) builder = gdk_memory_texture_builder_new ();
+
+      gdk_memory_texture_builder_set_width (builder, width);
+      gdk_memory_texture_builder_set_height (builder, height);
+      gdk_memory_texture_builder_set_format (builder, format);
+      gdk_memory_texture_builder_set_bytes (builder, bytes);
+      gdk_memory_texture_builder_set_stride (builder, stride);
+      gdk_memory_texture_builder_set_update_texture (builder, update_texture);
+      gdk_memory_texture_builder_set_update_region (builder, (cairo_region_t *) update_region);
+
+      return gdk_memory_texture_builder_build (builder);
+    }
+#endif
+
+  return gdk_memory_texture_new (width, height, format, bytes, stride);
+}
+
+static gboolean
+swapped_for_format (uint32_t format)
+{
+  switch (format)
+    {
+    case DRM_FORMAT_XBGR1555:
+    case DRM_FORMAT_BGR565:
+    case DRM_FORMAT_XBGR8888:
+    case DRM_FORMAT_XBGR2101010:
+    case DRM_FORMAT_ABGR8888:
+    case DRM_FORMAT_ABGR16161616F:
+      return TRUE;
+    default:
+      return FALSE;
+    }
+}
+
+static gboolean
+is_yuv_format (uint32_t format)
+{
+  switch (format)
+    {
+    case DRM_FORMAT_NV12:
+    case DRM_FORMAT_NV21:
+    case DRM_FORMAT_NV16:
+    case DRM_FORMAT_NV61:
+    case DRM_FORMAT_P010:
+    case DRM_FORMAT_P012:
+    case DRM_FORMAT_P016:
+    case DRM_FORMAT_YUV420:
+    case DRM_FORMAT_YVU420:
+      return TRUE;
+    default:
+      return FALSE;
+    }
+}
+
+static void
+query_egl_formats (EGLDisplay display, GArray *formats)
+{
+  g_autofree EGLint *fourccs = NULL;
+  EGLint n_fourccs;
+
+  if (!epoxy_has_egl_extension (display, "EGL_EXT_image_dma_buf_import_modifiers")
+      || !eglQueryDmaBufFormatsEXT (display, 0, NULL, &n_fourccs)
+      || n_fourccs <= 0)
+    return;
+
+  fourccs = g_new (EGLint, n_fourccs);
+  if (!eglQueryDmaBufFormatsEXT (display, n_fourccs, fourccs, &n_fourccs))
+    return;
+
+  for (EGLint i = 0; i < n_fourccs; i++)
+    {
+      g_autofree EGLuint64KHR *modifiers = NULL;
+      g_autofree EGLBoolean *external_only = NULL;
+      EGLint n_modifiers;
+
+      if (!eglQueryDmaBufModifiersEXT (display, fourccs[i], 0, NULL, NULL, &n_modifiers))
+        continue;
+      if (n_modifiers == 0)
+        {
+          DrmFormat format = { fourccs[i], DRM_FORMAT_MOD_INVALID };
+
+          g_array_append_val (formats, format);
+          continue;
+        }
+
+      modifiers = g_new (EGLuint64KHR, n_modifiers);
+      external_only = g_new (EGLBoolean, n_modifiers);
+      if (!eglQueryDmaBufModifiersEXT (display, fourccs[i], n_modifiers,
+                                       modifiers, external_only, &n_modifiers))
+        continue;
+
+      for (EGLint j = 0; j < n_modifiers; j++)
+        {
+          DrmFormat format = { fourccs[i], modifiers[j] };
+
+          /* YUV is only ever sampled through GL_TEXTURE_EXTERNAL_OES */
+          if (!external_only[j] || is_yuv_format (fourccs[i]))
+            g_array_append_val (formats, format);
+        }
+    }
+}
+
+static GArray *
+query_dri3_modifiers (GtkEglImageWidget *ewidget, guint32 fourcc)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  xcb_connection_t *conn = XGetXCBConnection (priv->x11.display);
+  GdkSurface *surface = gtk_native_get_surface (gtk_widget_get_native (GTK_WIDGET (ewidget)));
+  g_autofree xcb_dri3_get_supported_modifiers_reply_t *reply = NULL;
+  GArray *modifiers = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+  reply = xcb_dri3_get_supported_modifiers_reply (
+      conn,
+      xcb_dri3_get_supported_modifiers (conn, gdk_x11_surface_get_xid (surface),
+                                        depth_for_format (fourcc), bpp_for_format (fourcc) * 8),
+      NULL);
+  if (reply)
+    {
+      g_array_append_vals (modifiers, xcb_dri3_get_supported_modifiers_window_modifiers (reply),
+                           xcb_dri3_get_supported_modifiers_window_modifiers_length (reply));
+      g_array_append_vals (modifiers, xcb_dri3_get_supported_modifiers_screen_modifiers (reply),
+                           xcb_dri3_get_supported_modifiers_screen_modifiers_length (reply));
+    }
+
+  return modifiers;
+}
+
+/* lower is better, negative means the path cannot present it */
+static int
+rank_format (GtkEglImageWidget *ewidget, const DrmFormat *format, GArray **dri3_modifiers)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  GdkMemoryFormat memory_format;
+
+  /* YUV needs a conversion pass that in turn needs to see the format */
+  if (is_yuv_format (format->fourcc))
+    return priv->has_dmabuf_export ? 3 : -1;
+
+  if (priv->is_glx)
+    {
+      gboolean supported = format->modifier == DRM_FORMAT_MOD_INVALID
+                           || format->modifier == DRM_FORMAT_MOD_LINEAR;
+
+      if (!depth_for_format (format->fourcc))
+        return -1;
+
+      if (*dri3_modifiers == NULL)
+        *dri3_modifiers = query_dri3_modifiers (ewidget, format->fourcc);
+      for (guint i = 0; !supported && i < (*dri3_modifiers)->len; i++)
+        supported = g_array_index (*dri3_modifiers, guint64, i) == format->modifier;
+      if (!supported)
+        return -1;
+
+      return swapped_for_format (format->fourcc) ? 1 : 0;
+    }
+
+  if (priv->gdk_context)
+    return 0;
+
+  if (!memory_format_for_format (format->fourcc, &memory_format))
+    return 2;
+
+  return format->modifier == DRM_FORMAT_MOD_LINEAR ? 0 : 1;
+}
+
+static gboolean
+has_format (GArray *formats, guint32 fourcc, guint64 modifier)
+{
+  for (guint i = 0; i < formats->len; i++)
+    {
+      const DrmFormat *format = &g_array_index (formats, DrmFormat, i);
+
+      if (format->fourcc == fourcc && format->modifier == modifier)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static GArray *
+negotiate_formats (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  g_autoptr (GArray) candidates = g_array_new (FALSE, FALSE, sizeof (DrmFormat));
+  GArray *formats = g_array_new (FALSE, FALSE, sizeof (DrmFormat));
+  g_autoptr (GArray) ranks = NULL;
+  int max_rank = -1;
+
+  query_egl_formats (priv->display, candidates);
+
+#if GTK_CHECK_VERSION (4, 14, 0)
+  /* GDK already lists its formats in preference order */
+  if (priv->use_dmabuf_texture)
+    {
+      GdkDmabufFormats *dmabuf_formats =
+        gdk_display_get_dmabuf_formats (gtk_widget_get_display (GTK_WIDGET (ewidget)));
+
+      for (gsize i = 0; i < gdk_dmabuf_formats_get_n_formats (dmabuf_formats); i++)
+        {
+          DrmFormat format;
+
+          gdk_dmabuf_formats_get_format (dmabuf_formats, i, &format.fourcc, &format.modifier);
+          if (candidates->len == 0 || has_format (candidates, format.fourcc, format.modifier))
+            g_array_append_val (formats, format);
+        }
+
+      /* YUV that GDK cannot take is converted on import */
+      for (guint i = 0; i < candidates->len; i++)
+        {
+          const DrmFormat *format = &g_array_index (candidates, DrmFormat, i);
+
+          if (is_yuv_format (format->fourcc)
+              && !has_format (formats, format->fourcc, format->modifier))
+            g_array_append_val (formats, *format);
+        }
+
+      return formats;
+    }
+#endif
+
+  ranks = g_array_sized_new (FALSE, FALSE, sizeof (int), candidates->len);
+  for (guint i = 0; i < candidates->len;)
+    {
+      const DrmFormat *format = &g_array_index (candidates, DrmFormat, i);
+      g_autoptr (GArray) dri3_modifiers = NULL;
+      guint32 fourcc = format->fourcc;
+
+      /* EGL lists all modifiers of a format together */
+      for (; i < candidates->len && g_array_index (candidates, DrmFormat, i).fourcc == fourcc; i++)
+        {
+          int rank = rank_format (ewidget, &g_array_index (candidates, DrmFormat, i), &dri3_modifiers);
+
+          g_array_append_val (ranks, rank);
+          max_rank = MAX (max_rank, rank);
+        }
+    }
+
+  for (int rank = 0; rank <= max_rank; rank++)
+    for (guint i = 0; i < candidates->len; i++)
+      if (g_array_index (ranks, int, i) == rank)
+        g_array_append_val (formats, g_array_index (candidates, DrmFormat, i));
+
+  return formats;
+}
+
+static void
+wait_frame_sync (GtkEglImageWidget *ewidget, Frame *frame, gboolean gpu_wait)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  if (frame->sync == EGL_NO_SYNC_KHR)
+    return;
+
+  if (gpu_wait && priv->has_wait_sync)
+    eglWaitSyncKHR (frame->display, frame->sync, 0);
+  else
+    eglClientWaitSyncKHR (frame->display, frame->sync,
+                          EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+
+  eglDestroySyncKHR (frame->display, g_steal_pointer (&frame->sync));
+}
+
+static void
+attach_frame_sync_to_dmabuf (GtkEglImageWidget *ewidget, Frame *frame, int fd)
+{
+#ifdef DMA_BUF_IOCTL_IMPORT_SYNC_FILE
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  EGLint sync_type;
+
+  if (frame->sync == EGL_NO_SYNC_KHR)
+    return;
+
+  if (priv->has_native_fence
+      && eglGetSyncAttribKHR (frame->display, frame->sync, EGL_SYNC_TYPE_KHR, &sync_type)
+      && sync_type == EGL_SYNC_NATIVE_FENCE_ANDROID)
+    {
+      struct dma_buf_import_sync_file req = { .flags = DMA_BUF_SYNC_WRITE };
+
+      req.fd = eglDupNativeFenceFDANDROID (frame->display, frame->sync);
+      if (req.fd != EGL_NO_NATIVE_FENCE_FD_ANDROID)
+        {
+          int ret = ioctl (fd, DMA_BUF_IOCTL_IMPORT_SYNC_FILE, &req);
+
+          close (req.fd);
+          if (ret == 0)
+            {
+              eglDestroySyncKHR (frame->display, g_steal_pointer (&frame->sync));
+              return;
+            }
+        }
+    }
+#endif
+
+  wait_frame_sync (ewidget, frame, FALSE);
+}
+
+static void
+add_stage_sample (GtkEglImageWidget *ewidget, GtkEglImageWidgetStage stage, gint64 start)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  gtk_egl_image_widget_stats_add_sample (priv->stats, stage, g_get_monotonic_time () - start);
+  profiler_add_mark (start * 1000, gtk_egl_image_widget_stats_get_stage_name (stage), NULL);
+}
+
+static void
+gpu_timer_collect (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  GLint disjoint = GL_FALSE;
+
+  if (!epoxy_is_desktop_gl ())
+    glGetIntegerv (GL_GPU_DISJOINT_EXT, &disjoint);
+
+  for (; priv->gpu_timer.n_pending > 0; priv->gpu_timer.n_pending--)
+    {
+      guint oldest = (priv->gpu_timer.head + GPU_TIMER_QUERIES - priv->gpu_timer.n_pending) % GPU_TIMER_QUERIES;
+      GLuint available = GL_FALSE;
+      GLuint64 elapsed;
+
+      glGetQueryObjectuiv (priv->gpu_timer.queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available)
+        break;
+
+      glGetQueryObjectui64v (priv->gpu_timer.queries[oldest], GL_QUERY_RESULT, &elapsed);
+      if (!disjoint)
+        gtk_egl_image_widget_stats_add_sample (priv->stats, GTK_EGL_IMAGE_WIDGET_STAGE_GPU_IMPORT,
+                                               elapsed / 1000);
+    }
+}
+
+/* must be called with the widget's import context current */
+static void
+gpu_timer_begin (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  GLuint *query;
+
+  /* the queries belong to the widget's own context */
+  if (import_context (ewidget) != priv->gdk_context)
+    return;
+
+  if (!priv->timer_query_checked)
+    {
+      if (epoxy_is_desktop_gl ())
+        priv->has_timer_query = epoxy_gl_version () >= 33 || epoxy_has_gl_extension ("GL_ARB_timer_query");
+      else
+        priv->has_timer_query = epoxy_has_gl_extension ("GL_EXT_disjoint_timer_query");
+      priv->timer_query_checked = TRUE;
+    }
+  if (!priv->has_timer_query)
+    return;
+
+  gpu_timer_collect (ewidget);
+  if (priv->gpu_timer.n_pending == GPU_TIMER_QUERIES)
+    return;
+
+  query = &priv->gpu_timer.queries[priv->gpu_timer.head];
+  if (*query == 0)
+    glGenQueries (1, query);
+  glBeginQuery (GL_TIME_ELAPSED, *query);
+  priv->gpu_timer.active = TRUE;
+}
+
+static void
+gpu_timer_end (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  if (!priv->gpu_timer.active)
+    return;
+
+  glEndQuery (GL_TIME_ELAPSED);
+  priv->gpu_timer.head = (priv->gpu_timer.head + 1) % GPU_TIMER_QUERIES;
+  priv->gpu_timer.n_pending++;
+  priv->gpu_timer.active = FALSE;
+}
+
+static void
+gpu_timer_clear (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  for (guint i = 0; i < GPU_TIMER_QUERIES; i++)
+    if (priv->gpu_timer.queries[i])
+      glDeleteQueries (1, &priv->gpu_timer.queries[i]);
+  memset (&priv->gpu_timer, 0, sizeof priv->gpu_timer);
+  priv->timer_query_checked = FALSE;
+  priv->has_timer_query = FALSE;
+}
+
+static gboolean
+gtk_egl_image_widget_update_image_glx (GtkEglImageWidget *ewidget, Frame *frame)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  EGLTextureData *image_data = frame->image_data;
+  EGLImage image = image_data->image;
+  int width = frame->width;
+  int height = frame->height;
+  int fourcc, num_planes;
+  EGLuint64KHR modifiers;
+  int fds[4] = { -1, -1, -1, -1 };
+  EGLint strides[4] = { 0, };
+  EGLint offsets[4] = { 0, };
+  xcb_connection_t *conn;
+  GtkRoot *root;
+  GdkSurface *surface;
+  Window win;
+  guint depth, bpp;
+  Pixmap pixmap;
+  xcb_void_cookie_t cookie;
+  GLXPixmap glxpixmap;
+  GLXFBConfig fb_config;
+  GLXPixmapCacheEntry *entry = NULL;
+  struct stat st;
+  gboolean cacheable;
+  gint64 start = g_get_monotonic_time ();
+  g_autoptr (GdkTexture) texture = NULL;
+  static const int pixmap_attribs[] = {
+    GLX_TEXTURE_TARGET_EXT, GLX_TEXTURE_2D_EXT,
+    GLX_TEXTURE_FORMAT_EXT, GLX_TEXTURE_FORMAT_RGBA_EXT,
+    None
+  };
+
+  if (!make_current_internal (ewidget))
+    return FALSE;
+
+  if (!eglExportDMABUFImageQueryMESA (priv->display, image, &fourcc, &num_planes, &modifiers))
+    {
+      gtk_egl_image_widget_set_last_egl_error (ewidget, "eglExportDMABUFImageQueryMESA");
+      return FALSE;
+    }
+  g_assert (num_planes >= 1 && num_planes <= 4);
+  depth = depth_for_format (fourcc);
+  bpp = bpp_for_format (fourcc) * 8;
+
+  if (!depth || !bpp)
+    {
+      gtk_egl_image_widget_set_error_literal (
+          ewidget, "Unsupported DMABUF format 0x%08x for GLX import", fourcc);
+      return FALSE;
+    }
+
+  if (!eglExportDMABUFImageMESA (priv->display, image, fds, strides, offsets))
+    {
+      gtk_egl_image_widget_set_last_egl_error (ewidget, "eglExportDMABUFImageMESA");
+      return FALSE;
+    }
+
+  attach_frame_sync_to_dmabuf (ewidget, frame, fds[0]);
+  add_stage_sample (ewidget, GTK_EGL_IMAGE_WIDGET_STAGE_EXPORT, start);
+  start = g_get_monotonic_time ();
+
+  make_gdk_current_internal (ewidget, import_context (ewidget));
+
+  if (priv->x11.pixmap_cache == NULL)
+    priv->x11.pixmap_cache = g_ptr_array_new_with_free_func (glx_pixmap_cache_entry_unref);
+  glx_pixmap_cache_evict_size (priv->x11.pixmap_cache, width, height);
+
+  cacheable = fstat (fds[0], &st) == 0;
+  if (cacheable)
+    entry = glx_pixmap_cache_lookup (priv->x11.pixmap_cache, st.st_ino,
+                                     width, height, fourcc, modifiers);
+
+  if (entry)
+    {
+      for (int i = 0; i < num_planes; i++)
+        if (fds[i] != -1)
+          close (fds[i]);
+
+      gpu_timer_begin (ewidget);
+      glBindTexture (GL_TEXTURE_2D, entry->texid);
+      glXReleaseTexImageEXT (priv->x11.display, entry->glxpixmap, GLX_FRONT_LEFT_EXT);
+      glXBindTexImageEXT (priv->x11.display, entry->glxpixmap, GLX_FRONT_LEFT_EXT, NULL);
+      glBindTexture (GL_TEXTURE_2D, 0);
+      gpu_timer_end (ewidget);
+
+      texture = gl_texture_new (import_context (ewidget), entry->texid, width, height,
+                                priv->texture, frame->damage,
+                                free_glx_texture_data,
+                                glx_texture_data_new (entry, image_data));
+      g_set_object (&priv->texture, texture);
+      priv->swap_rb = swapped_for_format (fourcc) && !entry->swizzled;
+      frame->image_data = NULL;
+      clear_current_internal (ewidget);
+      add_stage_sample (ewidget, GTK_EGL_IMAGE_WIDGET_STAGE_IMPORT, start);
+      return TRUE;
+    }
+
+  conn = XGetXCBConnection (priv->x11.display);
+  root = gtk_widget_get_root (GTK_WIDGET (ewidget));
+  surface = gtk_native_get_surface (GTK_NATIVE (root));
+  win = gdk_x11_surface_get_xid (surface);
+
+  fb_config = shared_display_get_fb_config (priv->shared, depth);
+  if (fb_config == NULL)
+    {
+      gtk_egl_image_widget_set_error_literal (
+          ewidget, "No compatible GLXFBConfig found for depth %d", depth);
+      for (int i = 0; i < num_planes; i++)
+        if (fds[i] != -1)
+          close (fds[i]);
+      clear_current_internal (ewidget);
+      return FALSE;
+    }
+
+  pixmap = xcb_generate_id (conn);
+
+  if ((modifiers != DRM_FORMAT_MOD_INVALID && modifiers != DRM_FORMAT_MOD_LINEAR) || num_planes > 1)
+    cookie =
+       xcb_dri3_pixmap_from_buffers_checked (conn, pixmap, win, num_planes,
+                                             width, height,
+                                             strides[0], offsets[0],
+                                             strides[1], offsets[1],
+                                             strides[2], offsets[2],
+                                             strides[3], offsets[3],
+                                             depth, bpp, modifiers, fds);
+  else
+    cookie =
+       xcb_dri3_pixmap_from_buffer_checked (conn, pixmap, win,
+                                            height * strides[0],
+                                            width, height, strides[0],
+                                            depth, bpp, fds[0]);
+
+  xcb_discard_reply (conn, cookie.sequence);
+
+  glxpixmap = glXCreatePixmap (priv->x11.display, fb_config,
+                               pixmap, pixmap_attribs);
+  gtk_egl_image_widget_stats_add_allocation (priv->stats);
+
+  entry = g_new0 (GLXPixmapCacheEntry, 1);
+  g_atomic_ref_count_init (&entry->ref_count);
+  entry->conn = conn;
+  entry->display = priv->x11.display;
+  entry->context = g_object_ref (import_context (ewidget));
+  entry->pixmap = pixmap;
+  entry->glxpixmap = glxpixmap;
+  entry->inode = cacheable ? st.st_ino : 0;
+  entry->width = width;
+  entry->height = height;
+  entry->fourcc = fourcc;
+  entry->modifier = modifiers;
+
+  gpu_timer_begin (ewidget);
+  glGenTextures (1, &entry->texid);
+  glBindTexture (GL_TEXTURE_2D, entry->texid);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  if (swapped_for_format (fourcc)
+      && (epoxy_gl_version () >= 33 || epoxy_has_gl_extension ("GL_ARB_texture_swizzle")))
+    {
+      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_BLUE);
+      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+      entry->swizzled = TRUE;
+    }
+  glXBindTexImageEXT (priv->x11.display, entry->glxpixmap, GLX_FRONT_LEFT_EXT, NULL);
+  glBindTexture (GL_TEXTURE_2D, 0);
+  gpu_timer_end (ewidget);
+
+  texture = gl_texture_new (import_context (ewidget), entry->texid, width, height,
+                            priv->texture, frame->damage,
+                            free_glx_texture_data,
+                            glx_texture_data_new (entry, image_data));
+  g_set_object (&priv->texture, texture);
+  priv->swap_rb = swapped_for_format (fourcc) && !entry->swizzled;
+
+  if (cacheable)
+    {
+      g_ptr_array_add (priv->x11.pixmap_cache, entry);
+      if (priv->x11.pixmap_cache->len > GLX_PIXMAP_CACHE_SIZE)
+        g_ptr_array_remove_index (priv->x11.pixmap_cache, 0);
+    }
+  else
+    glx_pixmap_cache_entry_unref (entry);
+
+  frame->image_data = NULL;
+  clear_current_internal (ewidget);
+  add_stage_sample (ewidget, GTK_EGL_IMAGE_WIDGET_STAGE_IMPORT, start);
+  return TRUE;
+}
+
+static Frame *
+gtk_egl_image_widget_render_frame (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  EGLImage image = EGL_NO_IMAGE;
+  gint64 start = g_get_monotonic_time ();
+  Frame *frame;
+
+  g_signal_emit (ewidget, signals[RENDER], 0, &image);
+  context_state_invalidate ();
+
+  settle_render_targets (ewidget, image);
+
+  frame = g_new0 (Frame, 1);
+  frame->error = g_steal_pointer (&priv->render_error);
+  frame->content_static = priv->render_static;
+  priv->render_static = FALSE;
+
+  /* nothing new this time, which only stops the ticks if the producer
+   * also said so */
+  if (image == EGL_NO_IMAGE)
+    {
+      if (priv->render_sync != EGL_NO_SYNC_KHR)
+        eglDestroySyncKHR (priv->display, g_steal_pointer (&priv->render_sync));
+      g_clear_pointer (&priv->render_damage, cairo_region_destroy);
+      priv->render_release.func = NULL;
+      priv->render_release.data = NULL;
+      return frame;
+    }
+
+  frame->image_data = egl_texture_data_new (ewidget, image);
+  frame->display = priv->display;
+  frame->sync = g_steal_pointer (&priv->render_sync);
+  frame->damage = g_steal_pointer (&priv->render_damage);
+  frame->render_time = g_get_monotonic_time () - start;
+  add_stage_sample (ewidget, GTK_EGL_IMAGE_WIDGET_STAGE_RENDER, start);
+  frame->width = priv->render_width;
+  frame->height = priv->render_height;
+
+  return frame;
+}
+
+static gboolean
+queue_draw_idle (gpointer user_data)
+{
+  gtk_widget_queue_draw (GTK_WIDGET (user_data));
+  return G_SOURCE_REMOVE;
+}
+
+static void
+readback_resolve (GtkEglImageWidget *ewidget, guint min_resolve);
+
+static void
+readback_slot_release (ReadbackSlot *slot)
+{
+  if (slot->fence)
+    {
+      glDeleteSync (slot->fence);
+      slot->fence = NULL;
+    }
+  g_clear_pointer (&slot->region, cairo_region_destroy);
+  g_clear_pointer (&slot->image_data, free_egl_texture_data);
+}
+
+static void
+readback_clear (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  for (guint i = 0; i < READBACK_SLOTS; i++)
+    {
+      ReadbackSlot *slot = &priv->readback.slots[i];
+
+      readback_slot_release (slot);
+      if (slot->pbo)
+        glDeleteBuffers (1, &slot->pbo);
+    }
+  if (priv->readback.fbo)
+    glDeleteFramebuffers (1, &priv->readback.fbo);
+  g_clear_pointer (&priv->readback.last_bytes, g_bytes_unref);
+  memset (&priv->readback, 0, sizeof priv->readback);
+}
+
+static void
+readback_discard (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  for (; priv->readback.n_pending > 0; priv->readback.n_pending--)
+    {
+      guint oldest = (priv->readback.head + READBACK_SLOTS - priv->readback.n_pending) % READBACK_SLOTS;
+
+      readback_slot_release (&priv->readback.slots[oldest]);
+    }
+  g_clear_pointer (&priv->readback.last_bytes, g_bytes_unref);
+}
+
+static cairo_region_t *
+readback_region (GtkEglImageWidget *ewidget, Frame *frame)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  cairo_rectangle_int_t bounds = { 0, 0, frame->width, frame->height };
+  cairo_region_t *region;
+
+  if (frame->damage == NULL || priv->readback.last_bytes == NULL
+      || priv->readback.last_width != frame->width
+      || priv->readback.last_height != frame->height)
+    return NULL;
+
+  /* the newest ready slot is applied on top of the last resolved frame,
+   * so it has to carry the damage of every slot still in flight */
+  region = cairo_region_copy (frame->damage);
+  for (guint i = 1; i <= priv->readback.n_pending; i++)
+    {
+      ReadbackSlot *slot = &priv->readback.slots[(priv->readback.head + READBACK_SLOTS - i) % READBACK_SLOTS];
+
+      if (slot->region == NULL)
+        {
+          cairo_region_destroy (region);
+          return NULL;
+        }
+      cairo_region_union (region, slot->region);
+    }
+  cairo_region_intersect_rectangle (region, &bounds);
+
+  return region;
+}
+
+static void
+readback_issue (GtkEglImageWidget *ewidget, Frame *frame)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  const gsize size = frame->width * frame->height * 4;
+  ReadbackSlot *slot;
+  GLuint texid;
+  GLint old_align, old_row_length;
+
+  if (priv->readback.n_pending == READBACK_SLOTS)
+    readback_resolve (ewidget, 1);
+
+  slot = &priv->readback.slots[priv->readback.head];
+  slot->region = readback_region (ewidget, frame);
+
+  if (priv->readback.fbo == 0)
+    glGenFramebuffers (1, &priv->readback.fbo);
+  if (slot->pbo == 0)
+    glGenBuffers (1, &slot->pbo);
+
+  glBindBuffer (GL_PIXEL_PACK_BUFFER, slot->pbo);
+  if (slot->size != size)
+    {
+      glBufferData (GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+      slot->size = size;
+      gtk_egl_image_widget_stats_add_allocation (priv->stats);
+    }
+
+  glGenTextures (1, &texid);
+  glBindTexture (GL_TEXTURE_2D, texid);
+  glEGLImageTargetTexture2DOES (GL_TEXTURE_2D, frame->image_data->image);
+  glBindTexture (GL_TEXTURE_2D, 0);
+
+  glBindFramebuffer (GL_READ_FRAMEBUFFER, priv->readback.fbo);
+  glFramebufferTexture2D (GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texid, 0);
+
+  glGetIntegerv (GL_PACK_ALIGNMENT, &old_align);
+  glGetIntegerv (GL_PACK_ROW_LENGTH, &old_row_length);
+  glPixelStorei (GL_PACK_ALIGNMENT, 4);
+  glPixelStorei (GL_PACK_ROW_LENGTH, frame->width);
+  gpu_timer_begin (ewidget);
+  if (slot->region)
+    {
+      for (int i = 0; i < cairo_region_num_rectangles (slot->region); i++)
+        {
+          cairo_rectangle_int_t rect;
+
+          cairo_region_get_rectangle (slot->region, i, &rect);
+          glReadPixels (rect.x, rect.y, rect.width, rect.height, GL_RGBA, GL_UNSIGNED_BYTE,
+                        GSIZE_TO_POINTER (((gsize) rect.y * frame->width + rect.x) * 4));
+        }
+    }
+  else
+    glReadPixels (0, 0, frame->width, frame->height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  gpu_timer_end (ewidget);
+  glPixelStorei (GL_PACK_ROW_LENGTH, old_row_length);
+  glPixelStorei (GL_PACK_ALIGNMENT, old_align);
+
+  glFramebufferTexture2D (GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+  glBindFramebuffer (GL_READ_FRAMEBUFFER, 0);
+  glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+  glDeleteTextures (1, &texid);
+
+  slot->fence = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  if (!priv->batching)
+    glFlush ();
+
+  /* the image stays referenced until its pixels have landed in the PBO */
+  slot->image_data = g_steal_pointer (&frame->image_data);
+  slot->width = frame->width;
+  slot->height = frame->height;
+
+  priv->readback.head = (priv->readback.head + 1) % READBACK_SLOTS;
+  priv->readback.n_pending++;
+}
+
+static void
+readback_resolve (GtkEglImageWidget *ewidget, guint min_resolve)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  ReadbackSlot *ready = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (GdkTexture) texture = NULL;
+  gpointer data;
+
+  for (guint i = 0; priv->readback.n_pending > 0; i++)
+    {
+      guint oldest = (priv->readback.head + READBACK_SLOTS - priv->readback.n_pending) % READBACK_SLOTS;
+      ReadbackSlot *slot = &priv->readback.slots[oldest];
+      GLenum status;
+
+      if (i < min_resolve)
+        status = glClientWaitSync (slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, G_MAXUINT64);
+      else
+        status = glClientWaitSync (slot->fence, 0, 0);
+
+      if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        break;
+
+      if (ready)
+        readback_slot_release (ready);
+      ready = slot;
+      priv->readback.n_pending--;
+    }
+
+  if (ready == NULL)
+    return;
+
+  glBindBuffer (GL_PIXEL_PACK_BUFFER, ready->pbo);
+  data = glMapBufferRange (GL_PIXEL_PACK_BUFFER, 0, ready->size, GL_MAP_READ_BIT);
+  if (data)
+    {
+      PoolBuffer *buffer = buffer_pool_acquire (priv->buffer_pool, ready->size);
+      const gsize stride = ready->width * 4;
+
+      if (ready->region && priv->readback.last_bytes)
+        {
+          memcpy (buffer->data, g_bytes_get_data (priv->readback.last_bytes, NULL), ready->size);
+          for (int i = 0; i < cairo_region_num_rectangles (ready->region); i++)
+            {
+              cairo_rectangle_int_t rect;
+
+              cairo_region_get_rectangle (ready->region, i, &rect);
+              for (int y = rect.y; y < rect.y + rect.height; y++)
+                {
+                  gsize offset = y * stride + rect.x * 4;
+
+                  memcpy ((guchar *) buffer->data + offset, (guchar *) data + offset, rect.width * 4);
+                }
+            }
+        }
+      else
+        memcpy (buffer->data, data, ready->size);
+      glUnmapBuffer (GL_PIXEL_PACK_BUFFER);
+
+      bytes = pool_buffer_to_bytes (buffer);
+      texture = memory_texture_new (ready->width, ready->height, GDK_MEMORY_R8G8B8A8,
+                                    bytes, stride,
+                                    priv->readback.last_bytes ? priv->texture : NULL,
+                                    ready->region);
+      g_set_object (&priv->texture, texture);
+
+      g_clear_pointer (&priv->readback.last_bytes, g_bytes_unref);
+      priv->readback.last_bytes = g_bytes_ref (bytes);
+      priv->readback.last_width = ready->width;
+      priv->readback.last_height = ready->height;
+    }
+  glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+
+  readback_slot_release (ready);
+}
+
+typedef struct
+{
+  int             fd;
+  gpointer        map;
+  gsize           size;
+  EGLTextureData *image_data;
+} MappedDmabuf;
+
+static void
+mapped_dmabuf_release (gpointer data)
+{
+  MappedDmabuf *mapped = data;
+  struct dma_buf_sync sync = { .flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ };
+
+  ioctl (mapped->fd, DMA_BUF_IOCTL_SYNC, &sync);
+  munmap (mapped->map, mapped->size);
+  close (mapped->fd);
+  free_egl_texture_data (mapped->image_data);
+  g_free (mapped);
+}
+
+static gboolean
+import_mapped_dmabuf (GtkEglImageWidget *ewidget, Frame *frame)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  EGLImage image = frame->image_data->image;
+  int fourcc, num_planes;
+  EGLuint64KHR modifier;
+  int fds[4] = { -1, -1, -1, -1 };
+  EGLint strides[4] = { 0, };
+  EGLint offsets[4] = { 0, };
+  GdkMemoryFormat format;
+  struct dma_buf_sync sync = { .flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ };
+  MappedDmabuf *mapped;
+  gpointer map;
+  gsize size;
+  gint64 start = g_get_monotonic_time ();
+  g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (GdkTexture) texture = NULL;
+
+  if (!priv->has_dmabuf_export)
+    return FALSE;
+
+  if (!eglExportDMABUFImageQueryMESA (priv->display, image, &fourcc, &num_planes, &modifier)
+      || num_planes != 1
+      || modifier != DRM_FORMAT_MOD_LINEAR
+      || !memory_format_for_format (fourcc, &format))
+    return FALSE;
+
+  if (!eglExportDMABUFImageMESA (priv->display, image, fds, strides, offsets))
+    return FALSE;
+
+  attach_frame_sync_to_dmabuf (ewidget, frame, fds[0]);
+  add_stage_sample (ewidget, GTK_EGL_IMAGE_WIDGET_STAGE_EXPORT, start);
+  start = g_get_monotonic_time ();
+
+  size = (gsize) offsets[0] + (gsize) strides[0] * frame->height;
+  map = mmap (NULL, size, PROT_READ, MAP_SHARED, fds[0], 0);
+  if (map == MAP_FAILED)
+    {
+      close (fds[0]);
+      return FALSE;
+    }
+  ioctl (fds[0], DMA_BUF_IOCTL_SYNC, &sync);
+
+  mapped = g_new0 (MappedDmabuf, 1);
+  mapped->fd = fds[0];
+  mapped->map = map;
+  mapped->size = size;
+  mapped->image_data = g_steal_pointer (&frame->image_data);
+
+  bytes = g_bytes_new_with_free_func ((guchar *) map + offsets[0],
+                                      (gsize) strides[0] * frame->height,
+                                      mapped_dmabuf_release, mapped);
+  texture = memory_texture_new (frame->width, frame->height, format, bytes, strides[0],
+                                priv->texture, frame->damage);
+
+  /* older readbacks must not replace this frame once they complete */
+  readback_discard (ewidget);
+  g_set_object (&priv->texture, texture);
+  add_stage_sample (ewidget, GTK_EGL_IMAGE_WIDGET_STAGE_IMPORT, start);
+
+  return TRUE;
+}
+
+static void
+gtk_egl_image_widget_flush_readback (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  if (priv->readback.n_pending == 0)
+    return;
+
+  if (make_current_internal (ewidget))
+    {
+      readback_resolve (ewidget, 0);
+      clear_current_internal (ewidget);
+    }
+
+  if (priv->readback.n_pending > 0)
+    g_idle_add_full (G_PRIORITY_DEFAULT, queue_draw_idle,
+                     g_object_ref (ewidget), g_object_unref);
+}
+
+#if GTK_CHECK_VERSION (4, 14, 0)
+typedef struct
+{
+  int             fds[4];
+  int             n_fds;
+  EGLTextureData *image_data;
+} DmabufTextureData;
+
+static void
+free_dmabuf_texture_data (gpointer data)
+{
+  DmabufTextureData *tdata = data;
+
+  for (int i = 0; i < tdata->n_fds; i++)
+    close (tdata->fds[i]);
+  free_egl_texture_data (tdata->image_data);
+  g_free (tdata);
+}
+
+static gboolean
+import_dmabuf_texture (GtkEglImageWidget *ewidget, Frame *frame)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  GdkDisplay *display = gtk_widget_get_display (GTK_WIDGET (ewidget));
+  EGLImage image = frame->image_data->image;
+  int fourcc, num_planes;
+  EGLuint64KHR modifier;
+  int fds[4] = { -1, -1, -1, -1 };
+  EGLint strides[4] = { 0, };
+  EGLint offsets[4] = { 0, };
+  DmabufTextureData *tdata;
+  gint64 start = g_get_monotonic_time ();
+  g_autoptr (GdkDmabufTextureBuilder) builder = NULL;
+  g_autoptr (GdkTexture) texture = NULL;
+  g_autoptr (GError) error = NULL;
+
+  if (!eglExportDMABUFImageQueryMESA (priv->display, image, &fourcc, &num_planes, &modifier)
+      || !gdk_dmabuf_formats_contains (gdk_display_get_dmabuf_formats (display), fourcc, modifier))
+    return FALSE;
+
+  g_assert (num_planes >= 1 && num_planes <= 4);
+
+  if (!eglExportDMABUFImageMESA (priv->display, image, fds, strides, offsets))
+    return FALSE;
+
+  attach_frame_sync_to_dmabuf (ewidget, frame, fds[0]);
+  add_stage_sample (ewidget, GTK_EGL_IMAGE_WIDGET_STAGE_EXPORT, start);
+  start = g_get_monotonic_time ();
+
+  builder = gdk_dmabuf_texture_builder_new ();
+  gdk_dmabuf_texture_builder_set_display (builder, display);
+  gdk_dmabuf_texture_builder_set_width (builder, frame->width);
+  gdk_dmabuf_texture_builder_set_height (builder, frame->height);
+  gdk_dmabuf_texture_builder_set_fourcc (builder, fourcc);
+  gdk_dmabuf_texture_builder_set_modifier (builder, modifier);
+  gdk_dmabuf_texture_builder_set_n_planes (builder, num_planes);
+  for (int i = 0; i < num_planes; i++)
+    {
+      /* planes of the same buffer may share one fd */
+      gdk_dmabuf_texture_builder_set_fd (builder, i, fds[i] != -1 ? fds[i] : fds[0]);
+      gdk_dmabuf_texture_builder_set_stride (builder, i, strides[i]);
+      gdk_dmabuf_texture_builder_set_offset (builder, i, offsets[i]);
+    }
+
+  if (priv->texture && frame->damage
+      && gdk_texture_get_width (priv->texture) == frame->width
+      && gdk_texture_get_height (priv->texture) == frame->height)
+    {
+      gdk_dmabuf_texture_builder_set_update_texture (builder, priv->texture);
+      gdk_dmabuf_texture_builder_set_update_region (builder, frame->damage);
+    }
+
+  tdata = g_new0 (DmabufTextureData, 1);
+  for (int i = 0; i < num_planes; i++)
+    if (fds[i] != -1)
+      tdata->fds[tdata->n_fds++] = fds[i];
+
+  texture = gdk_dmabuf_texture_builder_build (builder, free_dmabuf_texture_data, tdata, &error);
+  if (texture == NULL)
+    {
+      g_debug ("Falling back from dmabuf texture: %s", error->message);
+      for (int i = 0; i < tdata->n_fds; i++)
+        close (tdata->fds[i]);
+      g_free (tdata);
+      return FALSE;
+    }
+
+  tdata->image_data = g_steal_pointer (&frame->image_data);
+
+  if (priv->readback.n_pending > 0 && make_current_internal (ewidget))
+    {
+      readback_discard (ewidget);
+      clear_current_internal (ewidget);
+    }
+  g_clear_pointer (&priv->readback.last_bytes, g_bytes_unref);
+
+  g_set_object (&priv->texture, texture);
+  priv->swap_rb = FALSE;
+  add_stage_sample (ewidget, GTK_EGL_IMAGE_WIDGET_STAGE_IMPORT, start);
+
+  return TRUE;
+}
+#else
+static gboolean
+import_dmabuf_texture (GtkEglImageWidget *ewidget, Frame *frame)
+{
+  return FALSE;
+}
+#endif
+
+static const char yuv_vertex_source[] =
+  "attribute vec2 position;\n"
+  "varying vec2 coord;\n"
+  "void main () {\n"
+  "  coord = position * 0.5 + 0.5;\n"
+  "  gl_Position = vec4 (position, 0.0, 1.0);\n"
+  "}\n";
+
+static const char yuv_fragment_source[] =
+  "uniform SAMPLER image;\n"
+  "varying vec2 coord;\n"
+  "void main () {\n"
+  "  FRAG_COLOR = TEXTURE (image, coord);\n"
+  "}\n";
+
+static GLuint
+compile_shader (GtkEglImageWidget  *ewidget,
+                GLenum              type,
+                const char * const *sources,
+                GLsizei             n_sources)
+{
+  GLuint shader = glCreateShader (type);
+  GLint status;
+
+  glShaderSource (shader, n_sources, (const GLchar * const *) sources, NULL);
+  glCompileShader (shader);
+  glGetShaderiv (shader, GL_COMPILE_STATUS, &status);
+  if (!status)
+    {
+      char log[512] = "";
+
+      glGetShaderInfoLog (shader, sizeof log, NULL, log);
+      gtk_egl_image_widget_set_error_literal (ewidget, "Could not compile YUV conversion shader: %s", log);
+      glDeleteShader (shader);
+      return 0;
+    }
+
+  return shader;
+}
+
+static gboolean
+yuv_converter_init (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  static const GLfloat quad[] = { -1.f, -1.f, 1.f, -1.f, -1.f, 1.f, 1.f, 1.f };
+  gboolean is_es = !epoxy_is_desktop_gl ();
+  gboolean has_external = epoxy_has_gl_extension ("GL_OES_EGL_image_external");
+  const char *vertex_sources[] = {
+    is_es ? "#version 100\n" : "#version 150\n#define attribute in\n#define varying out\n",
+    yuv_vertex_source,
+  };
+  /* without the external extension, rely on the driver converting YUV
+   * bound to GL_TEXTURE_2D */
+  const char *fragment_sources[] = {
+    is_es ? "#version 100\n" : "#version 150\n",
+    has_external ? "#extension GL_OES_EGL_image_external : require\n#define SAMPLER samplerExternalOES\n"
+                 : "#define SAMPLER sampler2D\n",
+    is_es ? "precision mediump float;\n#define TEXTURE texture2D\n#define FRAG_COLOR gl_FragColor\n"
+          : "#define varying in\n#define TEXTURE texture\n#define FRAG_COLOR frag_color\nout vec4 frag_color;\n",
+    yuv_fragment_source,
+  };
+  GLuint vertex, fragment;
+  GLint status;
+
+  vertex = compile_shader (ewidget, GL_VERTEX_SHADER, vertex_sources, G_N_ELEMENTS (vertex_sources));
+  if (!vertex)
+    return FALSE;
+  fragment = compile_shader (ewidget, GL_FRAGMENT_SHADER, fragment_sources, G_N_ELEMENTS (fragment_sources));
+  if (!fragment)
+    {
+      glDeleteShader (vertex);
+      return FALSE;
+    }
+
+  priv->yuv.program = glCreateProgram ();
+  glAttachShader (priv->yuv.program, vertex);
+  glAttachShader (priv->yuv.program, fragment);
+  glBindAttribLocation (priv->yuv.program, 0, "position");
+  glLinkProgram (priv->yuv.program);
+  glDeleteShader (vertex);
+  glDeleteShader (fragment);
+  glGetProgramiv (priv->yuv.program, GL_LINK_STATUS, &status);
+  if (!status)
+    {
+      char log[512] = "";
+
+      glGetProgramInfoLog (priv->yuv.program, sizeof log, NULL, log);
+      gtk_egl_image_widget_set_error_literal (ewidget, "Could not link YUV conversion program: %s", log);
+      glDeleteProgram (priv->yuv.program);
+      priv->yuv.program = 0;
+      return FALSE;
+    }
+
+  glUseProgram (priv->yuv.program);
+  glUniform1i (glGetUniformLocation (priv->yuv.program, "image"), 0);
+  glUseProgram (0);
+
+  glGenBuffers (1, &priv->yuv.buffer);
+  glBindBuffer (GL_ARRAY_BUFFER, priv->yuv.buffer);
+  glBufferData (GL_ARRAY_BUFFER, sizeof quad, quad, GL_STATIC_DRAW);
+
+  /* core profiles have no default vertex array */
+  if (!is_es || epoxy_gl_version () >= 30)
+    {
+      glGenVertexArrays (1, &priv->yuv.vertex_array);
+      glBindVertexArray (priv->yuv.vertex_array);
+      glEnableVertexAttribArray (0);
+      glVertexAttribPointer (0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+      glBindVertexArray (0);
+    }
+  glBindBuffer (GL_ARRAY_BUFFER, 0);
+
+  priv->yuv.texture_target = has_external ? GL_TEXTURE_EXTERNAL_OES : GL_TEXTURE_2D;
+
+  return TRUE;
+}
+
+/* needs the conversion context current */
+static void
+yuv_converter_clear (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  if (priv->yuv.program)
+    glDeleteProgram (priv->yuv.program);
+  if (priv->yuv.buffer)
+    glDeleteBuffers (1, &priv->yuv.buffer);
+  if (priv->yuv.vertex_array)
+    glDeleteVertexArrays (1, &priv->yuv.vertex_array);
+  g_clear_pointer (&priv->yuv.targets, g_ptr_array_unref);
+  memset (&priv->yuv, 0, sizeof priv->yuv);
+}
+
+static gboolean
+frame_is_yuv (GtkEglImageWidget *ewidget, Frame *frame)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  int fourcc, num_planes;
+  EGLuint64KHR modifier;
+
+  return priv->has_dmabuf_export
+         && eglExportDMABUFImageQueryMESA (priv->display, frame->image_data->image,
+                                           &fourcc, &num_planes, &modifier)
+         && is_yuv_format (fourcc);
+}
+
+typedef struct
+{
+  RenderTargetSlot *slot;
+  EGLTextureData   *source;
+} ConvertedImage;
+
+static void
+converted_image_release (EGLImage image, gpointer user_data)
+{
+  ConvertedImage *converted = user_data;
+
+  /* the producer gets its image back only once the copy is done with */
+  free_egl_texture_data (converted->source);
+  render_target_release (image, converted->slot);
+  g_free (converted);
+}
+
+/* replaces a YUV frame->image_data by an RGBA copy, for the paths that
+ * cannot take YUV as is */
+static gboolean
+convert_yuv_frame (GtkEglImageWidget *ewidget, Frame *frame)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  ConvertedImage *converted;
+  EGLTextureData *image_data;
+  RenderTargetSlot *slot;
+  GLuint texid;
+  gint64 begin_time = PROFILER_CURRENT_TIME;
+
+  if (!make_current_internal (ewidget))
+    return FALSE;
+  if (!priv->yuv.program && !yuv_converter_init (ewidget))
+    return FALSE;
+
+  slot = render_target_pool_acquire (ewidget, &priv->yuv.targets, min_render_targets (ewidget),
+                                     eglGetCurrentContext (), frame->width, frame->height);
+  if (slot == NULL)
+    {
+      g_debug ("No YUV conversion target available, dropping frame");
+      return FALSE;
+    }
+
+  wait_frame_sync (ewidget, frame, priv->gdk_context == NULL || !priv->owned_display);
+
+  glActiveTexture (GL_TEXTURE0);
+  glGenTextures (1, &texid);
+  glBindTexture (priv->yuv.texture_target, texid);
+  glTexParameteri (priv->yuv.texture_target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri (priv->yuv.texture_target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri (priv->yuv.texture_target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri (priv->yuv.texture_target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glEGLImageTargetTexture2DOES (priv->yuv.texture_target, frame->image_data->image);
+
+  glBindFramebuffer (GL_FRAMEBUFFER, slot->target.framebuffer);
+  glViewport (0, 0, frame->width, frame->height);
+  glDisable (GL_BLEND);
+  glDisable (GL_SCISSOR_TEST);
+  glUseProgram (priv->yuv.program);
+  if (priv->yuv.vertex_array)
+    glBindVertexArray (priv->yuv.vertex_array);
+  else
+    {
+      glBindBuffer (GL_ARRAY_BUFFER, priv->yuv.buffer);
+      glEnableVertexAttribArray (0);
+      glVertexAttribPointer (0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+    }
+  glDrawArrays (GL_TRIANGLE_STRIP, 0, 4);
+
+  if (priv->yuv.vertex_array)
+    glBindVertexArray (0);
+  else
+    {
+      glDisableVertexAttribArray (0);
+      glBindBuffer (GL_ARRAY_BUFFER, 0);
+    }
+  glUseProgram (0);
+  glBindFramebuffer (GL_FRAMEBUFFER, 0);
+  glBindTexture (priv->yuv.texture_target, 0);
+  glDeleteTextures (1, &texid);
+
+  /* the other paths read the copy back in this same context */
+  if (priv->is_glx && priv->has_native_fence)
+    {
+      frame->display = priv->display;
+      frame->sync = eglCreateSyncKHR (priv->display, EGL_SYNC_NATIVE_FENCE_ANDROID, NULL);
+    }
+  if (priv->is_glx && frame->sync == EGL_NO_SYNC_KHR)
+    glFinish ();
+  else if (!priv->batching)
+    glFlush ();
+
+  converted = g_new0 (ConvertedImage, 1);
+  converted->slot = render_target_slot_ref (slot);
+  converted->source = g_steal_pointer (&frame->image_data);
+
+  image_data = g_new0 (EGLTextureData, 1);
+  image_data->shared = shared_display_ref (priv->shared);
+  image_data->display = priv->display;
+  image_data->context = slot->context;
+  image_data->image = slot->target.image;
+  image_data->release_func = converted_image_release;
+  image_data->release_data = converted;
+  frame->image_data = image_data;
+
+  profiler_add_mark (begin_time, "yuv-convert", NULL);
+
+  return TRUE;
+}
+
+static void
+gtk_egl_image_widget_import_frame (GtkEglImageWidget *ewidget, Frame *frame)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  int width = frame->width;
+  int height = frame->height;
+  GLuint texid;
+  g_autoptr (GdkTexture) texture = NULL;
+
+  if (priv->use_dmabuf_texture && import_dmabuf_texture (ewidget, frame))
+    {
+      priv->import_path = "dmabuf";
+      frame_free (frame);
+      return;
+    }
+  if (frame_is_yuv (ewidget, frame) && !convert_yuv_frame (ewidget, frame))
+    {
+      frame_free (frame);
+      if (!priv->batching)
+        clear_current_internal (ewidget);
+      return;
+    }
+  if (priv->is_glx)
+    {
+      if (gtk_egl_image_widget_update_image_glx (ewidget, frame))
+        priv->import_path = "glx";
+      frame_free (frame);
+      if (!priv->batching)
+        clear_current_internal (ewidget);
+      return;
+    }
+  if (priv->gdk_context)
+    make_gdk_current_internal (ewidget, import_context (ewidget));
+  else if (!make_current_internal (ewidget))
+    {
+      frame_free (frame);
+      return;
+    }
+
+  wait_frame_sync (ewidget, frame, priv->gdk_context == NULL || !priv->owned_display);
+
+  if (priv->gdk_context)
+    {
+      gint64 start = g_get_monotonic_time ();
+
+      gpu_timer_begin (ewidget);
+      glGenTextures (1, &texid);
+      glBindTexture (GL_TEXTURE_2D, texid);
+      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glEGLImageTargetTexture2DOES (GL_TEXTURE_2D, frame->image_data->image);
+      glBindTexture (GL_TEXTURE_2D, 0);
+      gpu_timer_end (ewidget);
+      texture = gl_texture_new (import_context (ewidget), texid, width, height,
+                                priv->texture, frame->damage,
+                                free_egl_texture_data, g_steal_pointer (&frame->image_data));
+      priv->import_path = "egl";
+      add_stage_sample (ewidget, GTK_EGL_IMAGE_WIDGET_STAGE_IMPORT, start);
+    }
+  else if (priv->allow_mmap && import_mapped_dmabuf (ewidget, frame))
+    priv->import_path = "mmap";
+  else
+    {
+      gint64 start = g_get_monotonic_time ();
+
+      priv->import_path = "readback";
+      readback_issue (ewidget, frame);
+      readback_resolve (ewidget, priv->texture == NULL ? 1 : 0);
+      add_stage_sample (ewidget, GTK_EGL_IMAGE_WIDGET_STAGE_READBACK, start);
+    }
+
+  frame_free (frame);
+  if (texture)
+    g_set_object (&priv->texture, texture);
+  if (!priv->batching)
+    clear_current_internal (ewidget);
+}
+
+static void
+gtk_egl_image_widget_import_frame_timed (GtkEglImageWidget *ewidget, Frame *frame)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  gint64 render_time = frame->render_time;
+  gint64 start = g_get_monotonic_time ();
+
+  gtk_egl_image_widget_import_frame (ewidget, frame);
+
+  priv->dynamic.frame_time = render_time + g_get_monotonic_time () - start;
+}
+
+static void
+gtk_egl_image_widget_update_image (GtkEglImageWidget *ewidget)
+{
+  Frame *frame;
+  gboolean content_static;
+
+  clear_current_internal (ewidget);
+
+  frame = gtk_egl_image_widget_render_frame (ewidget);
+  content_static = frame->content_static;
+  if (frame->image_data)
+    gtk_egl_image_widget_import_frame_timed (ewidget, frame);
+  else
+    frame_free (frame);
+
+  set_content_static (ewidget, content_static);
+}
+
+static void
+queue_frame (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  if (priv->render_group && priv->ready && !priv->thread.thread
+      && gtk_widget_get_mapped (GTK_WIDGET (ewidget)))
+    gtk_egl_image_render_group_queue (priv->render_group, ewidget);
+  gtk_widget_queue_draw (GTK_WIDGET (ewidget));
+}
+
+static gboolean
+render_tick (GtkWidget     *widget,
+             GdkFrameClock *frame_clock,
+             gpointer       user_data)
+{
+  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (widget);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  gint64 frame_time = gdk_frame_clock_get_frame_time (frame_clock);
+
+  if (priv->max_fps > 0)
+    {
+      const gint64 interval = G_USEC_PER_SEC / priv->max_fps;
+      gint64 refresh_interval;
+
+      /* frame times jitter around the vblank, so round to the nearest one */
+      gdk_frame_clock_get_refresh_info (frame_clock, frame_time, &refresh_interval, NULL);
+      if (frame_time + refresh_interval / 2 < priv->next_frame_time)
+        return G_SOURCE_CONTINUE;
+
+      priv->next_frame_time += interval;
+      if (priv->next_frame_time <= frame_time)
+        priv->next_frame_time = frame_time + interval;
+    }
+
+  priv->needs_render = TRUE;
+  queue_frame (ewidget);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+update_render_scheduler (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  gboolean should_tick = priv->ready && priv->auto_render && !priv->content_static
+                         && !priv->error && gtk_widget_get_mapped (GTK_WIDGET (ewidget));
+
+  if (should_tick && priv->tick_id == 0)
+    {
+      priv->next_frame_time = 0;
+      priv->tick_id = gtk_widget_add_tick_callback (GTK_WIDGET (ewidget), render_tick, NULL, NULL);
+    }
+  else if (!should_tick && priv->tick_id != 0)
+    {
+      gtk_widget_remove_tick_callback (GTK_WIDGET (ewidget), priv->tick_id);
+      priv->tick_id = 0;
+    }
+}
+
+static void
+set_content_static (GtkEglImageWidget *ewidget, gboolean content_static)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  priv->content_static = content_static;
+  update_render_scheduler (ewidget);
+}
+
+static gboolean
+content_static_idle (gpointer user_data)
+{
+  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (user_data);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  gboolean content_static;
+
+  g_mutex_lock (&priv->thread.mutex);
+  content_static = priv->thread.content_static && !priv->thread.render_requested;
+  g_mutex_unlock (&priv->thread.mutex);
+
+  if (content_static && !priv->needs_render)
+    set_content_static (ewidget, TRUE);
+
+  return G_SOURCE_REMOVE;
+}
+
+typedef struct
+{
+  GtkEglImageWidget *ewidget;
+  GError            *error;
+} ThreadError;
+
+static void
+thread_error_free (gpointer data)
+{
+  ThreadError *terror = data;
+
+  g_object_unref (terror->ewidget);
+  g_clear_error (&terror->error);
+  g_free (terror);
+}
+
+static gboolean
+set_thread_error_idle (gpointer user_data)
+{
+  ThreadError *terror = user_data;
+
+  gtk_egl_image_widget_set_error (terror->ewidget, terror->error);
+  return G_SOURCE_REMOVE;
+}
+
+static GPrivate render_thread_widget;
+
+static gpointer
+render_thread_func (gpointer user_data)
+{
+  GtkEglImageWidget *ewidget = user_data;
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_private_set (&render_thread_widget, ewidget);
+
+  g_mutex_lock (&priv->thread.mutex);
+  while (TRUE)
+    {
+      int width, height;
+      gboolean failed;
+      Frame *frame;
+
+      while (!priv->thread.quit)
+        {
+          gboolean has_room = priv->thread.frames.length < priv->thread.max_frames;
+
+          if (priv->thread.render_requested
+              && (has_room || priv->thread.policy == GTK_EGL_IMAGE_FRAME_POLICY_MAILBOX))
+            break;
+          if (priv->thread.render_ahead && has_room && priv->thread.max_frames > 1)
+            break;
+          g_cond_wait (&priv->thread.cond, &priv->thread.mutex);
+        }
+      if (priv->thread.quit)
+        break;
+
+      priv->thread.render_requested = FALSE;
+      width = priv->thread.width;
+      height = priv->thread.height;
+      g_mutex_unlock (&priv->thread.mutex);
+
+      if (width != priv->render_width || height != priv->render_height)
+        {
+          gint64 begin_time = PROFILER_CURRENT_TIME;
+
+          priv->render_width = width;
+          priv->render_height = height;
+          g_signal_emit (ewidget, signals[RESIZE], 0, width, height);
+          context_state_invalidate ();
+          profiler_add_mark (begin_time, "resize", NULL);
+        }
+
+      frame = gtk_egl_image_widget_render_frame (ewidget);
+
+      /* the main thread only learns about it once the idle runs, so
+       * the frame carries it instead of priv->error */
+      failed = frame->error != NULL;
+      if (failed)
+        {
+          ThreadError *terror = g_new0 (ThreadError, 1);
+
+          terror->ewidget = g_object_ref (ewidget);
+          terror->error = g_steal_pointer (&frame->error);
+          g_idle_add_full (G_PRIORITY_DEFAULT, set_thread_error_idle, terror, thread_error_free);
+        }
+
+      g_mutex_lock (&priv->thread.mutex);
+      priv->thread.content_static = frame->content_static;
+      if (frame->content_static || failed)
+        priv->thread.render_ahead = FALSE;
+      if (frame->image_data)
+        {
+          g_queue_push_tail (&priv->thread.frames, frame);
+          while (priv->thread.frames.length > priv->thread.max_frames)
+            frame_drop (g_queue_pop_head (&priv->thread.frames),
+                        g_queue_peek_head (&priv->thread.frames));
+          g_idle_add_full (G_PRIORITY_DEFAULT, queue_draw_idle,
+                           g_object_ref (ewidget), g_object_unref);
+        }
+      else
+        {
+          if (frame->content_static)
+            g_idle_add_full (G_PRIORITY_DEFAULT, content_static_idle,
+                             g_object_ref (ewidget), g_object_unref);
+          frame_free (frame);
+        }
+    }
+  g_mutex_unlock (&priv->thread.mutex);
+
+  eglReleaseThread ();
+
+  return NULL;
+}
+
+static void
+start_render_thread (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_assert (priv->thread.thread == NULL);
+
+  /* the producer's context may not stay current here once it is used
+   * from the render thread */
+  clear_current_internal (ewidget);
+
+  priv->thread.quit = FALSE;
+  priv->thread.render_requested = FALSE;
+  priv->thread.render_ahead = FALSE;
+  priv->thread.max_frames = priv->max_frames_in_flight;
+  priv->thread.policy = priv->frame_policy;
+  priv->thread.width = priv->render_width;
+  priv->thread.height = priv->render_height;
+  priv->thread.thread = g_thread_new ("gtk-egl-image-render", render_thread_func, ewidget);
+}
+
+static void
+stop_render_thread (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  if (priv->thread.thread == NULL)
+    return;
+
+  g_mutex_lock (&priv->thread.mutex);
+  priv->thread.quit = TRUE;
+  g_cond_signal (&priv->thread.cond);
+  g_mutex_unlock (&priv->thread.mutex);
+
+  g_thread_join (g_steal_pointer (&priv->thread.thread));
+
+  g_queue_clear_full (&priv->thread.frames, (GDestroyNotify) frame_free);
+}
+
+static void
+gtk_egl_image_widget_map (GtkWidget *widget)
+{
+  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (widget);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  GTK_WIDGET_CLASS (gtk_egl_image_widget_parent_class)->map (widget);
+
+  if (priv->ready && priv->threaded && !priv->error)
+    start_render_thread (ewidget);
+  update_render_scheduler (ewidget);
+}
+
+static void
+gtk_egl_image_widget_unmap (GtkWidget *widget)
+{
+  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (widget);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  stop_render_thread (ewidget);
+  buffer_pool_trim (priv->buffer_pool);
+  update_render_scheduler (ewidget);
+
+  GTK_WIDGET_CLASS (gtk_egl_image_widget_parent_class)->unmap (widget);
+}
+
+static void
+update_dynamic_scale (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  GdkFrameClock *frame_clock = gtk_widget_get_frame_clock (GTK_WIDGET (ewidget));
+  double frame_time = priv->dynamic.frame_time;
+  double budget = priv->frame_budget * 1000.0;
+  double scale;
+
+  if (frame_time <= 0)
+    return;
+  priv->dynamic.frame_time = 0;
+
+  if (budget <= 0 && frame_clock)
+    {
+      gint64 refresh_interval;
+
+      gdk_frame_clock_get_refresh_info (frame_clock, gdk_frame_clock_get_frame_time (frame_clock),
+                                        &refresh_interval, NULL);
+      budget = refresh_interval;
+    }
+  if (budget <= 0)
+    budget = G_USEC_PER_SEC / 60.0;
+
+  if (priv->dynamic.n_frames == 0)
+    priv->dynamic.frame_time_avg = frame_time;
+  else
+    priv->dynamic.frame_time_avg = 0.9 * priv->dynamic.frame_time_avg + 0.1 * frame_time;
+  if (++priv->dynamic.n_frames < DYNAMIC_SCALE_SETTLE_FRAMES)
+    return;
+
+  /* frame time goes with the pixel count, so aim for 85% of the budget and
+   * only scale back up once there is a clear margin to avoid oscillating */
+  scale = priv->dynamic.scale;
+  if (priv->dynamic.frame_time_avg > budget)
+    scale *= sqrt (0.85 * budget / priv->dynamic.frame_time_avg);
+  else if (priv->dynamic.frame_time_avg < 0.6 * budget)
+    scale *= MIN (sqrt (0.85 * budget / priv->dynamic.frame_time_avg), 1.25);
+  scale = CLAMP (scale, DYNAMIC_SCALE_MIN, 1.0);
+
+  if (fabs (scale - priv->dynamic.scale) < 0.02)
+    return;
+
+  priv->dynamic.scale = scale;
+  priv->dynamic.n_frames = 0;
+  priv->needs_resize = TRUE;
+}
+
+static void
+compute_render_size (GtkEglImageWidget *ewidget,
+                     int                width,
+                     int                height,
+                     int               *render_width,
+                     int               *render_height)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  double scale = priv->render_scale > 0 ? priv->render_scale
+                                        : gtk_widget_get_scale_factor (GTK_WIDGET (ewidget));
+
+  if (priv->dynamic_resolution)
+    scale *= priv->dynamic.scale;
+
+  *render_width = MAX (1, (int) ceil (width * scale));
+  *render_height = MAX (1, (int) ceil (height * scale));
+}
+
+static gboolean
+compute_content_bounds (GtkEglImageWidget *ewidget,
+                        int                width,
+                        int                height,
+                        graphene_rect_t   *bounds)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  double content_width = priv->content_width;
+  double content_height = priv->content_height;
+  double scale;
+
+  if (priv->content_fit == GTK_CONTENT_FIT_FILL
+      || content_width <= 0 || content_height <= 0
+      || (content_width == width && content_height == height))
+    {
+      graphene_rect_init (bounds, 0.f, 0.f, width, height);
+      return FALSE;
+    }
+
+  switch (priv->content_fit)
+    {
+    case GTK_CONTENT_FIT_COVER:
+      scale = MAX (width / content_width, height / content_height);
+      break;
+    case GTK_CONTENT_FIT_SCALE_DOWN:
+      scale = MIN (1.0, MIN (width / content_width, height / content_height));
+      break;
+    case GTK_CONTENT_FIT_CONTAIN:
+    default:
+      scale = MIN (width / content_width, height / content_height);
+      break;
+    }
+
+  graphene_rect_init (bounds,
+                      (width - content_width * scale) / 2.0,
+                      (height - content_height * scale) / 2.0,
+                      content_width * scale,
+                      content_height * scale);
+
+  return priv->content_fit == GTK_CONTENT_FIT_COVER;
+}
+
+static void
+resize_render_targets (GtkEglImageWidget *ewidget,
+                       int                width,
+                       int                height,
+                       int                render_width,
+                       int                render_height)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  gint64 begin_time;
+
+  priv->render_width = render_width;
+  priv->render_height = render_height;
+  priv->content_width = width;
+  priv->content_height = height;
+  begin_time = PROFILER_CURRENT_TIME;
+  g_signal_emit (ewidget, signals[RESIZE], 0, render_width, render_height);
+  context_state_invalidate ();
+  profiler_add_mark (begin_time, "resize", NULL);
+  priv->needs_resize = FALSE;
+}
+
+gboolean
+gtk_egl_image_widget_batch_render (GtkEglImageWidget *ewidget)
+{
+  GtkWidget *widget = GTK_WIDGET (ewidget);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  int width = gtk_widget_get_width (widget);
+  int height = gtk_widget_get_height (widget);
+  int render_width, render_height;
+  Frame *frame;
+
+  if (!priv->ready || priv->error || priv->thread.thread || !gtk_widget_get_mapped (widget)
+      || !(priv->needs_render || (priv->auto_render && priv->needs_resize)))
+    return FALSE;
+
+  if (priv->dynamic_resolution)
+    update_dynamic_scale (ewidget);
+  compute_render_size (ewidget, width, height, &render_width, &render_height);
+  if (priv->needs_resize)
+    resize_render_targets (ewidget, width, height, render_width, render_height);
+
+  frame = gtk_egl_image_widget_render_frame (ewidget);
+  priv->needs_render = FALSE;
+  set_content_static (ewidget, frame->content_static);
+
+  if (frame->image_data)
+    {
+      priv->batch_frame = frame;
+      return TRUE;
+    }
+
+  frame_free (frame);
+  if (priv->error)
+    g_idle_add_full (G_PRIORITY_DEFAULT, queue_alloc, g_object_ref (widget), g_object_unref);
+
+  return FALSE;
+}
+
+void
+gtk_egl_image_widget_batch_import (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  if (priv->group_context == NULL && priv->gdk_context)
+    {
+      GdkSurface *surface = gdk_draw_context_get_surface (GDK_DRAW_CONTEXT (priv->gdk_context));
+
+      priv->group_context = gtk_egl_image_render_group_get_context (priv->render_group, surface);
+      context_state_invalidate ();
+    }
+
+  priv->batching = TRUE;
+  gtk_egl_image_widget_import_frame_timed (ewidget, g_steal_pointer (&priv->batch_frame));
+  priv->batching = FALSE;
+
+  if (priv->error)
+    g_idle_add_full (G_PRIORITY_DEFAULT, queue_alloc, g_object_ref (ewidget), g_object_unref);
+}
+
+void
+gtk_egl_image_widget_clear_current (GtkEglImageWidget *ewidget)
+{
+  context_state_invalidate ();
+  clear_current_internal (ewidget);
+}
+
+/* the members leave their imports unflushed, so one flush covers them all */
+void
+gtk_egl_image_widget_batch_flush (GtkEglImageWidget *ewidget)
+{
+  if (gdk_gl_context_get_current () || eglGetCurrentContext () != EGL_NO_CONTEXT)
+    glFlush ();
+  gtk_egl_image_widget_clear_current (ewidget);
+}
+
+static void
+gtk_egl_image_widget_snapshot (GtkWidget *widget, GtkSnapshot *snapshot)
+{
+  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (widget);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  int width = gtk_widget_get_width (widget);
+  int height = gtk_widget_get_height (widget);
+  int render_width, render_height;
+  gint64 start = g_get_monotonic_time ();
+
+  /* GSK may have switched contexts since the last frame */
+  context_state_invalidate ();
+
+  if (priv->error || !priv->ready)
+    {
+      GTK_WIDGET_CLASS (gtk_egl_image_widget_parent_class)->snapshot (widget, snapshot);
+      return;
+    }
+
+  if (priv->dynamic_resolution)
+    update_dynamic_scale (ewidget);
+  compute_render_size (ewidget, width, height, &render_width, &render_height);
+
+  if (priv->thread.thread)
+    {
+      Frame *frame;
+
+      g_mutex_lock (&priv->thread.mutex);
+      if (priv->frame_policy == GTK_EGL_IMAGE_FRAME_POLICY_MAILBOX)
+        while (priv->thread.frames.length > 1)
+          frame_drop (g_queue_pop_head (&priv->thread.frames),
+                      g_queue_peek_head (&priv->thread.frames));
+      frame = g_queue_pop_head (&priv->thread.frames);
+      if (frame && priv->thread.frames.length > 0)
+        g_idle_add_full (G_PRIORITY_DEFAULT, queue_draw_idle,
+                         g_object_ref (ewidget), g_object_unref);
+      priv->thread.render_ahead = priv->auto_render && !priv->content_static;
+      g_cond_signal (&priv->thread.cond);
+      if (priv->needs_render || (priv->auto_render && priv->needs_resize))
+        {
+          if (priv->needs_resize)
+            {
+              priv->thread.width = render_width;
+              priv->thread.height = render_height;
+              priv->content_width = width;
+              priv->content_height = height;
+              priv->needs_resize = FALSE;
+            }
+          priv->thread.render_requested = TRUE;
+          g_cond_signal (&priv->thread.cond);
+        }
+      g_mutex_unlock (&priv->thread.mutex);
+
+      if (frame)
+        {
+          gboolean content_static = frame->content_static;
+
+          gtk_egl_image_widget_import_frame_timed (ewidget, frame);
+          set_content_static (ewidget, content_static);
+        }
+
+      if (priv->error)
+        g_idle_add_full (G_PRIORITY_DEFAULT, queue_alloc, g_object_ref (widget), g_object_unref);
+    }
+  else if (priv->needs_render || (priv->auto_render && priv->needs_resize))
+    {
+      if (priv->needs_resize)
+        {
+          clear_current_internal (ewidget);
+          resize_render_targets (ewidget, width, height, render_width, render_height);
+        }
+
+      gtk_egl_image_widget_update_image (ewidget);
+
+      if (priv->error)
+        g_idle_add_full (G_PRIORITY_DEFAULT, queue_alloc, g_object_ref (widget), g_object_unref);
+    }
+
+  priv->needs_render = FALSE;
+
+  if (!priv->error)
+    gtk_egl_image_widget_flush_readback (ewidget);
+
+  if (priv->texture)
+    {
+      const graphene_rect_t clip = GRAPHENE_RECT_INIT (0.f, 0.f, width, height);
+      const gboolean needs_swap_rb = priv->swap_rb && (priv->is_glx || priv->gdk_context);
+      graphene_rect_t bounds;
+      gboolean needs_clip;
+
+      needs_clip = compute_content_bounds (ewidget, width, height, &bounds);
+
+      if (needs_clip)
+        gtk_snapshot_push_clip (snapshot, &clip);
+      if (needs_swap_rb)
+        gtk_snapshot_push_gl_shader (snapshot, get_swap_shader (), &bounds,
+                                     g_bytes_new (NULL, 0));
+
+#if GTK_CHECK_VERSION (4, 10, 0)
+      gtk_snapshot_append_scaled_texture (snapshot, priv->texture, GSK_SCALING_FILTER_LINEAR, &bounds);
+#else
+      gtk_snapshot_append_texture (snapshot, priv->texture, &bounds);
+#endif
+
+      if (needs_swap_rb)
+        {
+          gtk_snapshot_gl_shader_pop_texture (snapshot);
+          gtk_snapshot_pop (snapshot);
+        }
+      if (needs_clip)
+        gtk_snapshot_pop (snapshot);
+    }
+
+  add_stage_sample (ewidget, GTK_EGL_IMAGE_WIDGET_STAGE_SNAPSHOT, start);
+  gtk_egl_image_widget_stats_frame_done (priv->stats);
+}
+
+static void
+gtk_egl_image_widget_finalize (GObject *object)
+{
+  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (object);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_mutex_clear (&priv->thread.mutex);
+  g_cond_clear (&priv->thread.cond);
+  buffer_pool_unref (priv->buffer_pool);
+  g_object_unref (priv->stats);
+  g_clear_object (&priv->render_group);
+
+  G_OBJECT_CLASS (gtk_egl_image_widget_parent_class)->finalize (object);
+}
+
+static void
+gtk_egl_image_widget_set_property (GObject      *object,
+                                   guint         prop_id,
+                                   const GValue *value,
+                                   GParamSpec   *pspec)
+{
+  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (object);
+
+  switch (prop_id)
+    {
+    case PROP_AUTO_RENDER:
+      gtk_egl_image_widget_set_auto_render (ewidget, g_value_get_boolean (value));
+      break;
+    case PROP_N_RENDER_TARGETS:
+      gtk_egl_image_widget_set_n_render_targets (ewidget, g_value_get_uint (value));
+      break;
+    case PROP_THREADED:
+      gtk_egl_image_widget_set_threaded (ewidget, g_value_get_boolean (value));
+      break;
+    case PROP_MAX_FPS:
+      gtk_egl_image_widget_set_max_fps (ewidget, g_value_get_double (value));
+      break;
+    case PROP_RESIZE_DELAY:
+      gtk_egl_image_widget_set_resize_delay (ewidget, g_value_get_uint (value));
+      break;
+    case PROP_CONTENT_FIT:
+      gtk_egl_image_widget_set_content_fit (ewidget, g_value_get_enum (value));
+      break;
+    case PROP_DYNAMIC_RESOLUTION:
+      gtk_egl_image_widget_set_dynamic_resolution (ewidget, g_value_get_boolean (value));
+      break;
+    case PROP_FRAME_BUDGET:
+      gtk_egl_image_widget_set_frame_budget (ewidget, g_value_get_double (value));
+      break;
+    case PROP_RENDER_SCALE:
+      gtk_egl_image_widget_set_render_scale (ewidget, g_value_get_double (value));
+      break;
+    case PROP_ASYNC_REALIZE:
+      gtk_egl_image_widget_set_async_realize (ewidget, g_value_get_boolean (value));
+      break;
+    case PROP_RENDER_GROUP:
+      gtk_egl_image_widget_set_render_group (ewidget, g_value_get_object (value));
+      break;
+    case PROP_MAX_FRAMES_IN_FLIGHT:
+      gtk_egl_image_widget_set_max_frames_in_flight (ewidget, g_value_get_uint (value));
+      break;
+    case PROP_FRAME_POLICY:
+      gtk_egl_image_widget_set_frame_policy (ewidget, g_value_get_enum (value));
+      break;
+    case PROP_ALLOW_MMAP:
+      gtk_egl_image_widget_set_allow_mmap (ewidget, g_value_get_boolean (value));
+      break;
+    case PROP_SHARE_CONTEXT:
+      gtk_egl_image_widget_set_share_context (ewidget, g_value_get_boolean (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+gtk_egl_image_widget_get_property (GObject    *object,
+                                   guint       prop_id,
+                                   GValue     *value,
+                                   GParamSpec *pspec)
+{
+  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (object);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  switch (prop_id)
+    {
+    case PROP_AUTO_RENDER:
+      g_value_set_boolean (value, priv->auto_render);
+      break;
+    case PROP_N_RENDER_TARGETS:
+      g_value_set_uint (value, priv->n_render_targets);
+      break;
+    case PROP_THREADED:
+      g_value_set_boolean (value, priv->threaded);
+      break;
+    case PROP_MAX_FPS:
+      g_value_set_double (value, priv->max_fps);
+      break;
+    case PROP_RESIZE_DELAY:
+      g_value_set_uint (value, priv->resize_delay);
+      break;
+    case PROP_CONTENT_FIT:
+      g_value_set_enum (value, priv->content_fit);
+      break;
+    case PROP_DYNAMIC_RESOLUTION:
+      g_value_set_boolean (value, priv->dynamic_resolution);
+      break;
+    case PROP_FRAME_BUDGET:
+      g_value_set_double (value, priv->frame_budget);
+      break;
+    case PROP_RENDER_SCALE:
+      g_value_set_double (value, priv->render_scale);
+      break;
+    case PROP_ASYNC_REALIZE:
+      g_value_set_boolean (value, priv->async_realize);
+      break;
+    case PROP_RENDER_GROUP:
+      g_value_set_object (value, priv->render_group);
+      break;
+    case PROP_MAX_FRAMES_IN_FLIGHT:
+      g_value_set_uint (value, priv->max_frames_in_flight);
+      break;
+    case PROP_FRAME_POLICY:
+      g_value_set_enum (value, priv->frame_policy);
+      break;
+    case PROP_ALLOW_MMAP:
+      g_value_set_boolean (value, priv->allow_mmap);
+      break;
+    case PROP_SHARE_CONTEXT:
+      g_value_set_boolean (value, priv->share_context);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+gtk_egl_image_widget_notify (GObject *object, GParamSpec *pspec)
+{
+  if (g_strcmp0 (pspec->name, "scale-factor") == 0)
+    {
+      GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (object);
+      GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+      priv->needs_resize = TRUE;
+    }
+
+  if (G_OBJECT_CLASS (gtk_egl_image_widget_parent_class)->notify)
+    G_OBJECT_CLASS (gtk_egl_image_widget_parent_class)->notify (object, pspec);
+}
+
+static void
+gtk_egl_image_widget_class_init (GtkEglImageWidgetClass *class)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (class);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (class);
+
+  widget_class->realize = gtk_egl_image_widget_realize;
+  widget_class->unrealize = gtk_egl_image_widget_unrealize;
+  widget_class->map = gtk_egl_image_widget_map;
+  widget_class->unmap = gtk_egl_image_widget_unmap;
+  widget_class->size_allocate = gtk_egl_image_widget_size_allocate;
+  widget_class->snapshot = gtk_egl_image_widget_snapshot;
+
+  object_class->finalize = gtk_egl_image_widget_finalize;
+  object_class->set_property = gtk_egl_image_widget_set_property;
+  object_class->get_property = gtk_egl_image_widget_get_property;
+  object_class->notify = gtk_egl_image_widget_notify;
+
+  props[PROP_AUTO_RENDER]
+    = g_param_spec_boolean ("auto-render", NULL, NULL,
+                            TRUE,
+                            G_PARAM_READWRITE |
+                            G_PARAM_STATIC_STRINGS |
+                            G_PARAM_EXPLICIT_NOTIFY);
+  props[PROP_N_RENDER_TARGETS]
+    = g_param_spec_uint ("n-render-targets", NULL, NULL,
+                         1, 8, 3,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_STRINGS |
+                         G_PARAM_EXPLICIT_NOTIFY);
+  props[PROP_THREADED]
+    = g_param_spec_boolean ("threaded", NULL, NULL,
+                            FALSE,
+                            G_PARAM_READWRITE |
+                            G_PARAM_STATIC_STRINGS |
+                            G_PARAM_EXPLICIT_NOTIFY);
+  props[PROP_MAX_FPS]
+    = g_param_spec_double ("max-fps", NULL, NULL,
+                           0.0, 1000.0, 0.0,
+                           G_PARAM_READWRITE |
+                           G_PARAM_STATIC_STRINGS |
+                           G_PARAM_EXPLICIT_NOTIFY);
+  props[PROP_RESIZE_DELAY]
+    = g_param_spec_uint ("resize-delay", NULL, NULL,
+                         0, G_MAXUINT, 0,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_STRINGS |
+                         G_PARAM_EXPLICIT_NOTIFY);
+  props[PROP_CONTENT_FIT]
+    = g_param_spec_enum ("content-fit", NULL, NULL,
+                         GTK_TYPE_CONTENT_FIT,
+                         GTK_CONTENT_FIT_FILL,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_STRINGS |
+                         G_PARAM_EXPLICIT_NOTIFY);
+  props[PROP_DYNAMIC_RESOLUTION]
+    = g_param_spec_boolean ("dynamic-resolution", NULL, NULL,
+                            FALSE,
+                            G_PARAM_READWRITE |
+                            G_PARAM_STATIC_STRINGS |
+                            G_PARAM_EXPLICIT_NOTIFY);
+  props[PROP_FRAME_BUDGET]
+    = g_param_spec_double ("frame-budget", NULL, NULL,
+                           0.0, 1000.0, 0.0,
+                           G_PARAM_READWRITE |
+                           G_PARAM_STATIC_STRINGS |
+                           G_PARAM_EXPLICIT_NOTIFY);
+  props[PROP_RENDER_SCALE]
+    = g_param_spec_double ("render-scale", NULL, NULL,
+                           0.0, 8.0, 0.0,
+                           G_PARAM_READWRITE |
+                           G_PARAM_STATIC_STRINGS |
+                           G_PARAM_EXPLICIT_NOTIFY);
+  /* has no effect on X11 when GDK uses GLX, where opening our own
+   * EGLDisplay and the DRI3 and GLX setup need GDK's Xlib connection and
+   * so stay on the main thread */
+  props[PROP_ASYNC_REALIZE]
+    = g_param_spec_boolean ("async-realize", NULL, NULL,
+                            FALSE,
+                            G_PARAM_READWRITE |
+                            G_PARAM_STATIC_STRINGS |
+                            G_PARAM_EXPLICIT_NOTIFY);
+  props[PROP_RENDER_GROUP]
+    = g_param_spec_object ("render-group", NULL, NULL,
+                           GTK_TYPE_EGL_IMAGE_RENDER_GROUP,
+                           G_PARAM_READWRITE |
+                           G_PARAM_STATIC_STRINGS |
+                           G_PARAM_EXPLICIT_NOTIFY);
+  props[PROP_MAX_FRAMES_IN_FLIGHT]
+    = g_param_spec_uint ("max-frames-in-flight", NULL, NULL,
+                         1, 4, 1,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_STRINGS |
+                         G_PARAM_EXPLICIT_NOTIFY);
+  props[PROP_FRAME_POLICY]
+    = g_param_spec_enum ("frame-policy", NULL, NULL,
+                         GTK_TYPE_EGL_IMAGE_FRAME_POLICY,
+                         GTK_EGL_IMAGE_FRAME_POLICY_MAILBOX,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_STRINGS |
+                         G_PARAM_EXPLICIT_NOTIFY);
+  /* without GL in GDK, whether linear dmabufs may be read through a
+   * mapping rather than copied back through a PBO */
+  props[PROP_ALLOW_MMAP]
+    = g_param_spec_boolean ("allow-mmap", NULL, NULL,
+                            TRUE,
+                            G_PARAM_READWRITE |
+                            G_PARAM_STATIC_STRINGS |
+                            G_PARAM_EXPLICIT_NOTIFY);
+  /* whether the widget's own EGL context, where GDK's can't be used, is
+   * the one shared by every widget on the display; takes effect on the
+   * next realize, and widgets threaded by then always get their own */
+  props[PROP_SHARE_CONTEXT]
+    = g_param_spec_boolean ("share-context", NULL, NULL,
+                            TRUE,
+                            G_PARAM_READWRITE |
+                            G_PARAM_STATIC_STRINGS |
+                            G_PARAM_EXPLICIT_NOTIFY);
+
+  g_object_class_install_properties (object_class, LAST_PROP, props);
+
+  signals[RENDER]
+    = g_signal_new ("render",
+                    G_TYPE_FROM_CLASS (class),
+                    G_SIGNAL_RUN_LAST,
+                    G_STRUCT_OFFSET (GtkEglImageWidgetClass, render),
+                    g_signal_accumulator_first_wins, NULL,
+                    NULL,
+                    G_TYPE_POINTER, 0);
+  signals[RESIZE]
+    = g_signal_new ("resize",
+                    G_TYPE_FROM_CLASS (class),
+                    G_SIGNAL_RUN_LAST,
+                    G_STRUCT_OFFSET (GtkEglImageWidgetClass, resize),
+                    NULL, NULL,
+                    NULL,
+                    G_TYPE_NONE, 2, G_TYPE_INT, G_TYPE_INT);
+  signals[READY]
+    = g_signal_new ("ready",
+                    G_TYPE_FROM_CLASS (class),
+                    G_SIGNAL_RUN_LAST,
+                    G_STRUCT_OFFSET (GtkEglImageWidgetClass, ready),
+                    NULL, NULL,
+                    NULL,
+                    G_TYPE_NONE, 0);
+}
+
+GtkWidget *
+gtk_egl_image_widget_new (void)
+{
+  return g_object_new (GTK_TYPE_EGL_IMAGE_WIDGET, NULL);
+}
+
+EGLDisplay
+gtk_egl_image_widget_get_egl_display (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), EGL_NO_IMAGE);
+  g_return_val_if_fail (gtk_widget_get_realized (GTK_WIDGET (ewidget)), NULL);
+
+  return priv->display;
+}
+
+gboolean
+gtk_egl_image_widget_get_auto_render (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), FALSE);
+
+  return priv->auto_render;
+}
+
+void
+gtk_egl_image_widget_set_auto_render (GtkEglImageWidget *ewidget, gboolean auto_render)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+
+  auto_render = !!auto_render;
+  if (priv->auto_render != auto_render)
+    {
+      priv->auto_render = auto_render;
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_AUTO_RENDER]);
+      set_content_static (ewidget, FALSE);
+    }
+}
+
+gboolean
+gtk_egl_image_widget_get_threaded (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), FALSE);
+
+  return priv->threaded;
+}
+
+void
+gtk_egl_image_widget_set_threaded (GtkEglImageWidget *ewidget, gboolean threaded)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+
+  threaded = !!threaded;
+  if (priv->threaded != threaded)
+    {
+      priv->threaded = threaded;
+      if (priv->ready && gtk_widget_get_mapped (GTK_WIDGET (ewidget)))
+        {
+          if (threaded)
+            {
+              if (!priv->error)
+                start_render_thread (ewidget);
+            }
+          else
+            stop_render_thread (ewidget);
+          priv->needs_render = TRUE;
+          gtk_widget_queue_draw (GTK_WIDGET (ewidget));
+        }
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_THREADED]);
+    }
+}
+
+guint
+gtk_egl_image_widget_get_n_render_targets (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), 0);
+
+  return priv->n_render_targets;
+}
+
+void
+gtk_egl_image_widget_set_n_render_targets (GtkEglImageWidget *ewidget, guint n_render_targets)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+  g_return_if_fail (n_render_targets >= 1);
+
+  if (priv->n_render_targets != n_render_targets)
+    {
+      priv->n_render_targets = n_render_targets;
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_N_RENDER_TARGETS]);
+    }
+}
+
+const GtkEglImageRenderTarget *
+gtk_egl_image_widget_acquire_render_target (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  EGLContext context;
+  RenderTargetSlot *slot;
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), NULL);
+  g_return_val_if_fail (priv->display != EGL_NO_DISPLAY, NULL);
+
+  context = eglGetCurrentContext ();
+  if (context == EGL_NO_CONTEXT)
+    {
+      gtk_egl_image_widget_set_error_literal (ewidget, "No current EGL context for render target");
+      return NULL;
+    }
+
+  slot = render_target_pool_acquire (ewidget, &priv->render_targets,
+                                     MAX (priv->n_render_targets, min_render_targets (ewidget)),
+                                     context, priv->render_width, priv->render_height);
+
+  return slot ? &slot->target : NULL;
+}
+
+void
+gtk_egl_image_widget_set_render_sync (GtkEglImageWidget *ewidget, EGLSync sync)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+
+  if (priv->render_sync != EGL_NO_SYNC_KHR)
+    eglDestroySyncKHR (priv->display, priv->render_sync);
+  priv->render_sync = sync;
+}
+
+void
+gtk_egl_image_widget_set_release_func (GtkEglImageWidget      *ewidget,
+                                       GtkEglImageReleaseFunc  release_func,
+                                       gpointer                user_data)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+
+  priv->render_release.func = release_func;
+  priv->render_release.data = user_data;
+}
+
+void
+gtk_egl_image_widget_set_damage (GtkEglImageWidget    *ewidget,
+                                 const cairo_region_t *damage)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+
+  g_clear_pointer (&priv->render_damage, cairo_region_destroy);
+  if (damage)
+    priv->render_damage = cairo_region_copy (damage);
+}
+
+/* called from the render handler: what it returns, or the current
+ * contents for EGL_NO_IMAGE, stays valid until the next queue_render(),
+ * so auto-render can stop ticking until then */
+void
+gtk_egl_image_widget_set_content_static (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+
+  priv->render_static = TRUE;
+}
+
+static GArray *
+get_formats (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  if (priv->formats == NULL && priv->ready && !priv->error)
+    priv->formats = negotiate_formats (ewidget);
+
+  return priv->formats;
+}
+
+guint
+gtk_egl_image_widget_get_n_formats (GtkEglImageWidget *ewidget)
+{
+  GArray *formats;
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), 0);
+
+  formats = get_formats (ewidget);
+
+  return formats ? formats->len : 0;
+}
+
+gboolean
+gtk_egl_image_widget_get_format (GtkEglImageWidget *ewidget,
+                                 guint              idx,
+                                 guint32           *fourcc,
+                                 guint64           *modifier)
+{
+  GArray *formats;
+  const DrmFormat *format;
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), FALSE);
+
+  formats = get_formats (ewidget);
+  if (formats == NULL || idx >= formats->len)
+    return FALSE;
+
+  format = &g_array_index (formats, DrmFormat, idx);
+  if (fourcc)
+    *fourcc = format->fourcc;
+  if (modifier)
+    *modifier = format->modifier;
+
+  return TRUE;
+}
+
+GtkEglImageWidgetStats *
+gtk_egl_image_widget_get_stats (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), NULL);
+
+  return priv->stats;
+}
+
+/* the path the last frame reached GDK through, one of "dmabuf", "glx",
+ * "egl", "mmap" or "readback", or NULL before the first frame */
+const char *
+gtk_egl_image_widget_get_import_path (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), NULL);
+
+  return priv->import_path;
+}
+
+/* whether a frame could take @path once the widget is ready; dmabuf and
+ * GLX frames may still fall back to another path one by one */
+gboolean
+gtk_egl_image_widget_has_import_path (GtkEglImageWidget *ewidget,
+                                      const char        *path)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), FALSE);
+  g_return_val_if_fail (path != NULL, FALSE);
+
+  if (!priv->ready)
+    return FALSE;
+
+  if (g_str_equal (path, "dmabuf"))
+    return priv->use_dmabuf_texture;
+  if (g_str_equal (path, "glx"))
+    return priv->is_glx;
+  if (g_str_equal (path, "egl"))
+    return priv->gdk_context != NULL && !priv->is_glx;
+  if (g_str_equal (path, "mmap"))
+    return priv->gdk_context == NULL && priv->has_dmabuf_export && priv->allow_mmap;
+  if (g_str_equal (path, "readback"))
+    return priv->gdk_context == NULL;
+
+  return FALSE;
+}
+
+void
+gtk_egl_image_widget_get_buffer_pool_stats (GtkEglImageWidget *ewidget,
+                                            guint64           *hits,
+                                            guint64           *misses)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+
+  g_mutex_lock (&priv->buffer_pool->mutex);
+  if (hits)
+    *hits = priv->buffer_pool->hits;
+  if (misses)
+    *misses = priv->buffer_pool->misses;
+  g_mutex_unlock (&priv->buffer_pool->mutex);
+}
+
+void
+gtk_egl_image_widget_queue_render (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+
+  priv->needs_render = TRUE;
+  queue_frame (ewidget);
+  set_content_static (ewidget, FALSE);
+}
+
+double
+gtk_egl_image_widget_get_max_fps (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), 0.0);
+
+  return priv->max_fps;
+}
+
+void
+gtk_egl_image_widget_set_max_fps (GtkEglImageWidget *ewidget, double max_fps)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+  g_return_if_fail (max_fps >= 0.0);
+
+  if (priv->max_fps != max_fps)
+    {
+      priv->max_fps = max_fps;
+      priv->next_frame_time = 0;
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_MAX_FPS]);
+    }
+}
+
+guint
+gtk_egl_image_widget_get_resize_delay (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), 0);
+
+  return priv->resize_delay;
+}
+
+void
+gtk_egl_image_widget_set_resize_delay (GtkEglImageWidget *ewidget, guint resize_delay)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-  xcb_discard_reply (conn, cookie.sequence);
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
 
-  glxpixmap = glXCreatePixmap (priv->x11.display, priv->x11.fb_config,
-                               pixmap, pixmap_attribs);
+  if (priv->resize_delay != resize_delay)
+    {
+      priv->resize_delay = resize_delay;
+      gtk_widget_queue_allocate (GTK_WIDGET (ewidget));
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_RESIZE_DELAY]);
+    }
+}
 
-  texdata = g_new0 (GLXTextureData, 1);
-  texdata->conn = conn;
-  texdata->display = priv->x11.display;
-  texdata->pixmap = pixmap;
-  texdata->glxpixmap = glxpixmap;
+GtkContentFit
+gtk_egl_image_widget_get_content_fit (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-  glGenTextures (1, &texid);
-  glBindTexture (GL_TEXTURE_2D, texid);
-  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glXBindTexImageEXT (priv->x11.display, texdata->glxpixmap, GLX_FRONT_LEFT_EXT, NULL);
-  glBindTexture (GL_TEXTURE_2D, 0);
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), GTK_CONTENT_FIT_FILL);
 
-  texture = gdk_gl_texture_new (priv->gdk_context, texid, width, height,
-                                free_glx_texture_data, texdata);
-  g_set_object (&priv->texture, texture);
-  priv->swap_rb = swapped_for_format (fourcc);
-  gdk_gl_context_clear_current ();
+  return priv->content_fit;
 }
 
-static void
-gtk_egl_image_widget_update_image (GtkEglImageWidget *ewidget)
+void
+gtk_egl_image_widget_set_content_fit (GtkEglImageWidget *ewidget, GtkContentFit content_fit)
 {
   GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
-  int width = gtk_widget_get_width (GTK_WIDGET (ewidget));
-  int height = gtk_widget_get_height (GTK_WIDGET (ewidget));
-  EGLImage image = EGL_NO_IMAGE;
-  GLuint fbid, texid;
-  g_autoptr (GdkTexture) texture = NULL;
-
-  clear_current_internal (ewidget);
 
-  g_signal_emit (ewidget, signals[RENDER], 0, &image);
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
 
-  if (image == EGL_NO_IMAGE)
-    return;
-  if (priv->is_glx)
+  if (priv->content_fit != content_fit)
     {
-      gtk_egl_image_widget_update_image_glx (ewidget, image);
-      if (!make_current_internal (ewidget))
-        return;
-      eglDestroyImage (priv->display, image);
-      clear_current_internal (ewidget);
-      return;
+      priv->content_fit = content_fit;
+      gtk_widget_queue_draw (GTK_WIDGET (ewidget));
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_CONTENT_FIT]);
     }
-  if (!make_current_internal (ewidget))
-    return;
+}
 
-  glGenTextures (1, &texid);
-  if (priv->gdk_context)
-    {
-      EGLTextureData *texdata = g_new0 (EGLTextureData, 1);
+gboolean
+gtk_egl_image_widget_get_dynamic_resolution (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-      texdata->display = priv->display;
-      texdata->context = priv->egl_context;
-      texdata->image = image;
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), FALSE);
 
-      glBindTexture (GL_TEXTURE_2D, texid);
-      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-      glEGLImageTargetTexture2DOES (GL_TEXTURE_2D, image);
-      glBindTexture (GL_TEXTURE_2D, 0);
-      texture = gdk_gl_texture_new (priv->gdk_context, texid, width, height,
-                                    free_egl_texture_data, texdata);
-    }
-  else
+  return priv->dynamic_resolution;
+}
+
+void
+gtk_egl_image_widget_set_dynamic_resolution (GtkEglImageWidget *ewidget, gboolean dynamic_resolution)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+
+  dynamic_resolution = !!dynamic_resolution;
+  if (priv->dynamic_resolution != dynamic_resolution)
     {
-      const gsize size = width * height * 4;
-      gpointer data = g_malloc (size);
-      g_autoptr (GBytes) bytes = NULL;
-      GLint old_align;
+      priv->dynamic_resolution = dynamic_resolution;
+      priv->dynamic.n_frames = 0;
+      priv->dynamic.frame_time = 0;
+      if (priv->dynamic.scale != 1.0)
+        {
+          priv->dynamic.scale = 1.0;
+          priv->needs_resize = TRUE;
+          gtk_widget_queue_draw (GTK_WIDGET (ewidget));
+        }
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_DYNAMIC_RESOLUTION]);
+    }
+}
 
-      glBindTexture (GL_TEXTURE_2D, texid);
-      glEGLImageTargetTexture2DOES (GL_TEXTURE_2D, image);
-      glBindTexture (GL_TEXTURE_2D, 0);
+double
+gtk_egl_image_widget_get_frame_budget (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-      glGenFramebuffers (1, &fbid);
-      glBindFramebuffer (GL_READ_FRAMEBUFFER, fbid);
-      glFramebufferTexture2D (GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texid, 0);
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), 0.0);
 
-      glGetIntegerv (GL_PACK_ALIGNMENT, &old_align);
-      glPixelStorei (GL_PACK_ALIGNMENT, 4);
-      glReadPixels (0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
-      glPixelStorei (GL_PACK_ALIGNMENT, old_align);
+  return priv->frame_budget;
+}
 
-      glBindFramebuffer (GL_READ_FRAMEBUFFER, 0);
+void
+gtk_egl_image_widget_set_frame_budget (GtkEglImageWidget *ewidget, double frame_budget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-      glDeleteTextures (1, &texid);
-      glDeleteFramebuffers (1, &fbid);
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+  g_return_if_fail (frame_budget >= 0.0);
 
-      bytes = g_bytes_new_take (data, size);
-      texture = gdk_memory_texture_new (width, height, GDK_MEMORY_R8G8B8A8, bytes, width * 4);
+  if (priv->frame_budget != frame_budget)
+    {
+      priv->frame_budget = frame_budget;
+      priv->dynamic.n_frames = 0;
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_FRAME_BUDGET]);
     }
+}
 
-  g_set_object (&priv->texture, texture);
-  clear_current_internal (ewidget);
+double
+gtk_egl_image_widget_get_render_scale (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), 0.0);
+
+  return priv->render_scale;
 }
 
-static void
-gtk_egl_image_widget_snapshot (GtkWidget *widget, GtkSnapshot *snapshot)
+void
+gtk_egl_image_widget_set_render_scale (GtkEglImageWidget *ewidget, double render_scale)
 {
-  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (widget);
   GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
-  int width = gtk_widget_get_width (widget);
-  int height = gtk_widget_get_height (widget);
 
-  if (priv->error)
-    {
-      GTK_WIDGET_CLASS (gtk_egl_image_widget_parent_class)->snapshot (widget, snapshot);
-      return;
-    }
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+  g_return_if_fail (render_scale >= 0.0);
 
-  if (!priv->error && (priv->needs_render || priv->auto_render))
+  if (priv->render_scale != render_scale)
     {
-      if (priv->needs_resize)
+      priv->render_scale = render_scale;
+      if (gtk_widget_get_realized (GTK_WIDGET (ewidget)))
         {
-          clear_current_internal (ewidget);
-          g_signal_emit (ewidget, signals[RESIZE], 0, width, height);
-          priv->needs_resize = FALSE;
+          priv->needs_resize = TRUE;
+          gtk_widget_queue_draw (GTK_WIDGET (ewidget));
         }
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_RENDER_SCALE]);
+    }
+}
 
-      gtk_egl_image_widget_update_image (ewidget);
+gboolean
+gtk_egl_image_widget_get_async_realize (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-      if (priv->error)
-        g_idle_add_full (G_PRIORITY_DEFAULT, queue_alloc, g_object_ref (widget), g_object_unref);
-    }
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), FALSE);
 
-  priv->needs_render = FALSE;
+  return priv->async_realize;
+}
 
-  if (priv->texture)
+void
+gtk_egl_image_widget_set_async_realize (GtkEglImageWidget *ewidget, gboolean async_realize)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+
+  async_realize = !!async_realize;
+  if (priv->async_realize != async_realize)
     {
-      const graphene_rect_t bounds = GRAPHENE_RECT_INIT (0.f, 0.f, width, height);
-      const gboolean needs_swap_rb = priv->swap_rb && (priv->is_glx || priv->gdk_context);
+      priv->async_realize = async_realize;
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_ASYNC_REALIZE]);
+    }
+}
 
-      if (needs_swap_rb)
-        gtk_snapshot_push_gl_shader (snapshot, priv->swap_shader, &bounds,
-                                     g_bytes_new (NULL, 0));
+gboolean
+gtk_egl_image_widget_get_allow_mmap (GtkEglImageWidget *ewidget)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-      gtk_snapshot_append_texture (snapshot, priv->texture, &bounds);
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), FALSE);
 
-      if (needs_swap_rb)
-        {
-          gtk_snapshot_gl_shader_pop_texture (snapshot);
-          gtk_snapshot_pop (snapshot);
-        }
-    }
+  return priv->allow_mmap;
 }
 
-static void
-gtk_egl_image_widget_set_property (GObject      *object,
-                                   guint         prop_id,
-                                   const GValue *value,
-                                   GParamSpec   *pspec)
+void
+gtk_egl_image_widget_set_allow_mmap (GtkEglImageWidget *ewidget, gboolean allow_mmap)
 {
-  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (object);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-  switch (prop_id)
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+
+  allow_mmap = !!allow_mmap;
+  if (priv->allow_mmap != allow_mmap)
     {
-    case PROP_AUTO_RENDER:
-      gtk_egl_image_widget_set_auto_render (ewidget, g_value_get_boolean (value));
-      break;
-    default:
-      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      priv->allow_mmap = allow_mmap;
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_ALLOW_MMAP]);
     }
 }
 
-static void
-gtk_egl_image_widget_get_property (GObject    *object,
-                                   guint       prop_id,
-                                   GValue     *value,
-                                   GParamSpec *pspec)
+gboolean
+gtk_egl_image_widget_get_share_context (GtkEglImageWidget *ewidget)
 {
-  GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (object);
   GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-  switch (prop_id)
-    {
-    case PROP_AUTO_RENDER:
-      g_value_set_boolean (value, priv->auto_render);
-      break;
-    default:
-      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
-    }
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), FALSE);
+
+  return priv->share_context;
 }
 
-static void
-gtk_egl_image_widget_notify (GObject *object, GParamSpec *pspec)
+void
+gtk_egl_image_widget_set_share_context (GtkEglImageWidget *ewidget, gboolean share_context)
 {
-  if (g_strcmp0 (pspec->name, "scale-factor") == 0)
-    {
-      GtkEglImageWidget *ewidget = GTK_EGL_IMAGE_WIDGET (object);
-      GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-      priv->needs_resize = TRUE;
-    }
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
 
-  if (G_OBJECT_CLASS (gtk_egl_image_widget_parent_class)->notify)
-    G_OBJECT_CLASS (gtk_egl_image_widget_parent_class)->notify (object, pspec);
+  share_context = !!share_context;
+  if (priv->share_context != share_context)
+    {
+      priv->share_context = share_context;
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_SHARE_CONTEXT]);
+    }
 }
 
-static void
-gtk_egl_image_widget_class_init (GtkEglImageWidgetClass *class)
+guint
+gtk_egl_image_widget_get_max_frames_in_flight (GtkEglImageWidget *ewidget)
 {
-  GObjectClass *object_class = G_OBJECT_CLASS (class);
-  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (class);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-  widget_class->realize = gtk_egl_image_widget_realize;
-  widget_class->unrealize = gtk_egl_image_widget_unrealize;
-  widget_class->size_allocate = gtk_egl_image_widget_size_allocate;
-  widget_class->snapshot = gtk_egl_image_widget_snapshot;
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), 0);
 
-  object_class->set_property = gtk_egl_image_widget_set_property;
-  object_class->get_property = gtk_egl_image_widget_get_property;
-  object_class->notify = gtk_egl_image_widget_notify;
+  return priv->max_frames_in_flight;
+}
 
-  props[PROP_AUTO_RENDER]
-    = g_param_spec_boolean ("auto-render", NULL, NULL,
-                            TRUE,
-                            G_PARAM_READWRITE |
-                            G_PARAM_STATIC_STRINGS |
-                            G_PARAM_EXPLICIT_NOTIFY);
+void
+gtk_egl_image_widget_set_max_frames_in_flight (GtkEglImageWidget *ewidget,
+                                               guint              max_frames_in_flight)
+{
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-  g_object_class_install_properties (object_class, LAST_PROP, props);
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+  g_return_if_fail (max_frames_in_flight >= 1);
 
-  signals[RENDER]
-    = g_signal_new ("render",
-                    G_TYPE_FROM_CLASS (class),
-                    G_SIGNAL_RUN_LAST,
-                    G_STRUCT_OFFSET (GtkEglImageWidgetClass, render),
-                    g_signal_accumulator_first_wins, NULL,
-                    NULL,
-                    G_TYPE_POINTER, 0);
-  signals[RESIZE]
-    = g_signal_new ("resize",
-                    G_TYPE_FROM_CLASS (class),
-                    G_SIGNAL_RUN_LAST,
-                    G_STRUCT_OFFSET (GtkEglImageWidgetClass, resize),
-                    NULL, NULL,
-                    NULL,
-                    G_TYPE_NONE, 2, G_TYPE_INT, G_TYPE_INT);
+  if (priv->max_frames_in_flight != max_frames_in_flight)
+    {
+      priv->max_frames_in_flight = max_frames_in_flight;
+      g_mutex_lock (&priv->thread.mutex);
+      priv->thread.max_frames = max_frames_in_flight;
+      g_cond_signal (&priv->thread.cond);
+      g_mutex_unlock (&priv->thread.mutex);
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_MAX_FRAMES_IN_FLIGHT]);
+    }
 }
 
-GtkWidget *
-gtk_egl_image_widget_new (void)
+GtkEglImageFramePolicy
+gtk_egl_image_widget_get_frame_policy (GtkEglImageWidget *ewidget)
 {
-  return g_object_new (GTK_TYPE_EGL_IMAGE_WIDGET, NULL);
+  GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), GTK_EGL_IMAGE_FRAME_POLICY_MAILBOX);
+
+  return priv->frame_policy;
 }
 
-EGLDisplay
-gtk_egl_image_widget_get_egl_display (GtkEglImageWidget *ewidget)
+void
+gtk_egl_image_widget_set_frame_policy (GtkEglImageWidget      *ewidget,
+                                       GtkEglImageFramePolicy  frame_policy)
 {
   GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), EGL_NO_IMAGE);
-  g_return_val_if_fail (gtk_widget_get_realized (GTK_WIDGET (ewidget)), NULL);
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
 
-  return priv->display;
+  if (priv->frame_policy != frame_policy)
+    {
+      priv->frame_policy = frame_policy;
+      g_mutex_lock (&priv->thread.mutex);
+      priv->thread.policy = frame_policy;
+      g_cond_signal (&priv->thread.cond);
+      g_mutex_unlock (&priv->thread.mutex);
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_FRAME_POLICY]);
+    }
 }
 
-gboolean
-gtk_egl_image_widget_get_auto_render (GtkEglImageWidget *ewidget)
+GtkEglImageRenderGroup *
+gtk_egl_image_widget_get_render_group (GtkEglImageWidget *ewidget)
 {
   GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), FALSE);
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), NULL);
 
-  return priv->auto_render;
+  return priv->render_group;
 }
 
 void
-gtk_egl_image_widget_set_auto_render (GtkEglImageWidget *ewidget, gboolean auto_render)
+gtk_egl_image_widget_set_render_group (GtkEglImageWidget      *ewidget,
+                                       GtkEglImageRenderGroup *render_group)
 {
   GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
   g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+  g_return_if_fail (render_group == NULL || GTK_IS_EGL_IMAGE_RENDER_GROUP (render_group));
 
-  auto_render = !!auto_render;
-  if (priv->auto_render != auto_render)
+  if (priv->render_group != render_group)
     {
-      priv->auto_render = auto_render;
-      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_AUTO_RENDER]);
-      if (auto_render)
-        gtk_widget_queue_draw (GTK_WIDGET (ewidget));
+      if (priv->render_group)
+        gtk_egl_image_render_group_cancel (priv->render_group, ewidget);
+      if (priv->group_context)
+        {
+          g_clear_object (&priv->group_context);
+          context_state_invalidate ();
+        }
+      g_set_object (&priv->render_group, render_group);
+      g_object_notify_by_pspec (G_OBJECT (ewidget), props[PROP_RENDER_GROUP]);
     }
 }
 
-void
-gtk_egl_image_widget_queue_render (GtkEglImageWidget *ewidget)
+gboolean
+gtk_egl_image_widget_is_ready (GtkEglImageWidget *ewidget)
 {
   GtkEglImageWidgetPrivate *priv = gtk_egl_image_widget_get_instance_private (ewidget);
 
-  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget), FALSE);
 
-  priv->needs_render = TRUE;
-  gtk_widget_queue_draw (GTK_WIDGET (ewidget));
+  return priv->ready;
 }
 
 void
@@ -961,6 +4890,15 @@ gtk_egl_image_widget_set_error (GtkEglImageWidget *ewidget, const GError *error)
 
   g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET (ewidget));
 
+  /* handed to the main thread along with the frame being rendered */
+  if (g_private_get (&render_thread_widget) == ewidget)
+    {
+      g_clear_error (&priv->render_error);
+      if (error)
+        priv->render_error = g_error_copy (error);
+      return;
+    }
+
   g_clear_error (&priv->error);
   if (error)
     {
@@ -974,6 +4912,7 @@ gtk_egl_image_widget_set_error (GtkEglImageWidget *ewidget, const GError *error)
 
           while ((child = gtk_widget_get_first_child (GTK_WIDGET (ewidget))) != NULL)
             gtk_widget_unparent (child);
+          priv->placeholder = NULL;
 
           priv->label = gtk_label_new (NULL);
           gtk_label_set_justify (GTK_LABEL (priv->label), GTK_JUSTIFY_CENTER);
@@ -992,8 +4931,10 @@ gtk_egl_image_widget_set_error (GtkEglImageWidget *ewidget, const GError *error)
       while ((child = gtk_widget_get_first_child (GTK_WIDGET (ewidget))) != NULL)
         gtk_widget_unparent (child);
       priv->label = NULL;
+      priv->placeholder = NULL;
     }
 
+  update_render_scheduler (ewidget);
   gtk_widget_queue_draw (GTK_WIDGET (ewidget));
 }
 
@@ -3,6 +3,32 @@
 #include <epoxy/egl.h>
 #include <gtk/gtk.h>
 
+#include "gtkeglimagerendergroup.h"
+#include "gtkeglimagewidgetstats.h"
+
+typedef struct
+{
+  EGLImage image;
+  guint    texture;
+  guint    framebuffer;
+  int      width;
+  int      height;
+} GtkEglImageRenderTarget;
+
+/* called from whichever thread drops the last reference, with no
+ * particular context current */
+typedef void (* GtkEglImageReleaseFunc) (EGLImage image,
+                                         gpointer user_data);
+
+typedef enum
+{
+  GTK_EGL_IMAGE_FRAME_POLICY_MAILBOX,
+  GTK_EGL_IMAGE_FRAME_POLICY_FIFO
+} GtkEglImageFramePolicy;
+
+#define GTK_TYPE_EGL_IMAGE_FRAME_POLICY (gtk_egl_image_frame_policy_get_type ())
+GType gtk_egl_image_frame_policy_get_type (void);
+
 #define GTK_TYPE_EGL_IMAGE_WIDGET (gtk_egl_image_widget_get_type ())
 G_DECLARE_DERIVABLE_TYPE (GtkEglImageWidget, gtk_egl_image_widget, GTK, EGL_IMAGE_WIDGET, GtkWidget)
 
@@ -14,6 +40,7 @@ struct _GtkEglImageWidgetClass
   void     (* resize) (GtkEglImageWidget *ewidget,
                        int                width,
                        int                height);
+  void     (* ready)  (GtkEglImageWidget *ewidget);
 };
 
 GtkWidget *gtk_egl_image_widget_new                (void);
@@ -22,6 +49,76 @@ gboolean   gtk_egl_image_widget_get_auto_render    (GtkEglImageWidget *ewidget);
 void       gtk_egl_image_widget_set_auto_render    (GtkEglImageWidget *ewidget,
                                                     gboolean        auto_render);
 void       gtk_egl_image_widget_queue_render       (GtkEglImageWidget *ewidget);
+double     gtk_egl_image_widget_get_max_fps        (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_max_fps        (GtkEglImageWidget *ewidget,
+                                                    double             max_fps);
+guint      gtk_egl_image_widget_get_resize_delay   (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_resize_delay   (GtkEglImageWidget *ewidget,
+                                                    guint              resize_delay);
+GtkContentFit
+           gtk_egl_image_widget_get_content_fit    (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_content_fit    (GtkEglImageWidget *ewidget,
+                                                    GtkContentFit      content_fit);
+gboolean   gtk_egl_image_widget_get_dynamic_resolution (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_dynamic_resolution (GtkEglImageWidget *ewidget,
+                                                        gboolean           dynamic_resolution);
+double     gtk_egl_image_widget_get_frame_budget   (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_frame_budget   (GtkEglImageWidget *ewidget,
+                                                    double             frame_budget);
+double     gtk_egl_image_widget_get_render_scale   (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_render_scale   (GtkEglImageWidget *ewidget,
+                                                    double             render_scale);
+gboolean   gtk_egl_image_widget_get_async_realize  (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_async_realize  (GtkEglImageWidget *ewidget,
+                                                    gboolean           async_realize);
+gboolean   gtk_egl_image_widget_is_ready           (GtkEglImageWidget *ewidget);
+guint      gtk_egl_image_widget_get_max_frames_in_flight (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_max_frames_in_flight (GtkEglImageWidget *ewidget,
+                                                          guint              max_frames_in_flight);
+gboolean   gtk_egl_image_widget_get_share_context  (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_share_context  (GtkEglImageWidget *ewidget,
+                                                    gboolean           share_context);
+gboolean   gtk_egl_image_widget_get_allow_mmap     (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_allow_mmap     (GtkEglImageWidget *ewidget,
+                                                    gboolean           allow_mmap);
+GtkEglImageFramePolicy
+           gtk_egl_image_widget_get_frame_policy   (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_frame_policy   (GtkEglImageWidget      *ewidget,
+                                                    GtkEglImageFramePolicy  frame_policy);
+GtkEglImageRenderGroup *
+           gtk_egl_image_widget_get_render_group   (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_render_group   (GtkEglImageWidget      *ewidget,
+                                                    GtkEglImageRenderGroup *render_group);
+gboolean   gtk_egl_image_widget_get_threaded       (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_threaded       (GtkEglImageWidget *ewidget,
+                                                    gboolean           threaded);
+guint      gtk_egl_image_widget_get_n_render_targets (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_n_render_targets (GtkEglImageWidget *ewidget,
+                                                      guint              n_render_targets);
+const GtkEglImageRenderTarget *
+           gtk_egl_image_widget_acquire_render_target (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_set_render_sync    (GtkEglImageWidget *ewidget,
+                                                    EGLSync            sync);
+void       gtk_egl_image_widget_set_release_func   (GtkEglImageWidget      *ewidget,
+                                                    GtkEglImageReleaseFunc  release_func,
+                                                    gpointer                user_data);
+void       gtk_egl_image_widget_set_damage         (GtkEglImageWidget    *ewidget,
+                                                    const cairo_region_t *damage);
+void       gtk_egl_image_widget_set_content_static (GtkEglImageWidget *ewidget);
+guint      gtk_egl_image_widget_get_n_formats      (GtkEglImageWidget *ewidget);
+gboolean   gtk_egl_image_widget_get_format         (GtkEglImageWidget *ewidget,
+                                                    guint              idx,
+                                                    guint32           *fourcc,
+                                                    guint64           *modifier);
+GtkEglImageWidgetStats *
+           gtk_egl_image_widget_get_stats          (GtkEglImageWidget *ewidget);
+void       gtk_egl_image_widget_get_buffer_pool_stats (GtkEglImageWidget *ewidget,
+                                                       guint64           *hits,
+                                                       guint64           *misses);
+const char *
+           gtk_egl_image_widget_get_import_path    (GtkEglImageWidget *ewidget);
+gboolean   gtk_egl_image_widget_has_import_path    (GtkEglImageWidget *ewidget,
+                                                    const char        *path);
 void       gtk_egl_image_widget_set_error          (GtkEglImageWidget *ewidget,
                                                     const GError   *error);
 void       gtk_egl_image_widget_set_error_literal  (GtkEglImageWidget *ewidget,
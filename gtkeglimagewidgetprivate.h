@@ -0,0 +1,8 @@
+#pragma once
+
+#include "gtkeglimagewidget.h"
+
+gboolean gtk_egl_image_widget_batch_render   (GtkEglImageWidget *ewidget);
+void     gtk_egl_image_widget_batch_import   (GtkEglImageWidget *ewidget);
+void     gtk_egl_image_widget_clear_current  (GtkEglImageWidget *ewidget);
+void     gtk_egl_image_widget_batch_flush    (GtkEglImageWidget *ewidget);
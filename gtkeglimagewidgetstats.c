@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "gtkeglimagewidgetstatsprivate.h"
+
+#define STATS_WINDOW 128
+
+typedef struct
+{
+  gint64 samples[STATS_WINDOW];
+  guint  head;
+  guint  n_samples;
+} StageSamples;
+
+struct _GtkEglImageWidgetStats
+{
+  GObject      parent_instance;
+
+  GMutex       mutex;
+  StageSamples stages[GTK_EGL_IMAGE_WIDGET_N_STAGES];
+  guint        context_switches;
+  guint        context_switches_skipped;
+  guint        allocations;
+};
+
+G_DEFINE_TYPE (GtkEglImageWidgetStats, gtk_egl_image_widget_stats, G_TYPE_OBJECT)
+
+enum {
+  UPDATED,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = { 0, };
+
+static void
+gtk_egl_image_widget_stats_finalize (GObject *object)
+{
+  GtkEglImageWidgetStats *stats = GTK_EGL_IMAGE_WIDGET_STATS (object);
+
+  g_mutex_clear (&stats->mutex);
+
+  G_OBJECT_CLASS (gtk_egl_image_widget_stats_parent_class)->finalize (object);
+}
+
+static void
+gtk_egl_image_widget_stats_class_init (GtkEglImageWidgetStatsClass *class)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+  object_class->finalize = gtk_egl_image_widget_stats_finalize;
+
+  signals[UPDATED]
+    = g_signal_new ("updated",
+                    G_TYPE_FROM_CLASS (class),
+                    G_SIGNAL_RUN_LAST,
+                    0,
+                    NULL, NULL,
+                    NULL,
+                    G_TYPE_NONE, 0);
+}
+
+static void
+gtk_egl_image_widget_stats_init (GtkEglImageWidgetStats *stats)
+{
+  g_mutex_init (&stats->mutex);
+}
+
+GtkEglImageWidgetStats *
+gtk_egl_image_widget_stats_new (void)
+{
+  return g_object_new (GTK_TYPE_EGL_IMAGE_WIDGET_STATS, NULL);
+}
+
+void
+gtk_egl_image_widget_stats_add_sample (GtkEglImageWidgetStats *stats,
+                                       GtkEglImageWidgetStage  stage,
+                                       gint64                  usec)
+{
+  StageSamples *samples;
+
+  g_return_if_fail (stage < GTK_EGL_IMAGE_WIDGET_N_STAGES);
+
+  g_mutex_lock (&stats->mutex);
+  samples = &stats->stages[stage];
+  samples->samples[samples->head] = usec;
+  samples->head = (samples->head + 1) % STATS_WINDOW;
+  samples->n_samples = MIN (samples->n_samples + 1, STATS_WINDOW);
+  g_mutex_unlock (&stats->mutex);
+}
+
+void
+gtk_egl_image_widget_stats_add_context_switch (GtkEglImageWidgetStats *stats,
+                                               gboolean                skipped)
+{
+  if (skipped)
+    g_atomic_int_inc (&stats->context_switches_skipped);
+  else
+    g_atomic_int_inc (&stats->context_switches);
+}
+
+void
+gtk_egl_image_widget_stats_add_allocation (GtkEglImageWidgetStats *stats)
+{
+  g_atomic_int_inc (&stats->allocations);
+}
+
+void
+gtk_egl_image_widget_stats_frame_done (GtkEglImageWidgetStats *stats)
+{
+  g_signal_emit (stats, signals[UPDATED], 0);
+}
+
+const char *
+gtk_egl_image_widget_stats_get_stage_name (GtkEglImageWidgetStage stage)
+{
+  static const char * const names[] = {
+    [GTK_EGL_IMAGE_WIDGET_STAGE_RENDER] = "render",
+    [GTK_EGL_IMAGE_WIDGET_STAGE_EXPORT] = "export",
+    [GTK_EGL_IMAGE_WIDGET_STAGE_IMPORT] = "import",
+    [GTK_EGL_IMAGE_WIDGET_STAGE_READBACK] = "readback",
+    [GTK_EGL_IMAGE_WIDGET_STAGE_SNAPSHOT] = "snapshot",
+    [GTK_EGL_IMAGE_WIDGET_STAGE_GPU_IMPORT] = "gpu-import",
+  };
+
+  g_return_val_if_fail (stage < GTK_EGL_IMAGE_WIDGET_N_STAGES, NULL);
+
+  return names[stage];
+}
+
+guint
+gtk_egl_image_widget_stats_get_n_samples (GtkEglImageWidgetStats *stats,
+                                          GtkEglImageWidgetStage  stage)
+{
+  guint n_samples;
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET_STATS (stats), 0);
+  g_return_val_if_fail (stage < GTK_EGL_IMAGE_WIDGET_N_STAGES, 0);
+
+  g_mutex_lock (&stats->mutex);
+  n_samples = stats->stages[stage].n_samples;
+  g_mutex_unlock (&stats->mutex);
+
+  return n_samples;
+}
+
+static int
+compare_samples (gconstpointer a, gconstpointer b)
+{
+  gint64 sa = *(const gint64 *) a;
+  gint64 sb = *(const gint64 *) b;
+
+  return sa < sb ? -1 : sa > sb;
+}
+
+gboolean
+gtk_egl_image_widget_stats_get_timing (GtkEglImageWidgetStats *stats,
+                                       GtkEglImageWidgetStage  stage,
+                                       gint64                 *min,
+                                       gint64                 *avg,
+                                       gint64                 *p99)
+{
+  gint64 sorted[STATS_WINDOW];
+  gint64 sum = 0;
+  guint n_samples;
+
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET_STATS (stats), FALSE);
+  g_return_val_if_fail (stage < GTK_EGL_IMAGE_WIDGET_N_STAGES, FALSE);
+
+  g_mutex_lock (&stats->mutex);
+  n_samples = stats->stages[stage].n_samples;
+  memcpy (sorted, stats->stages[stage].samples, n_samples * sizeof (gint64));
+  g_mutex_unlock (&stats->mutex);
+
+  if (n_samples == 0)
+    return FALSE;
+
+  qsort (sorted, n_samples, sizeof (gint64), compare_samples);
+  for (guint i = 0; i < n_samples; i++)
+    sum += sorted[i];
+
+  if (min)
+    *min = sorted[0];
+  if (avg)
+    *avg = sum / n_samples;
+  if (p99)
+    *p99 = sorted[(n_samples * 99 + 99) / 100 - 1];
+
+  return TRUE;
+}
+
+void
+gtk_egl_image_widget_stats_get_context_switches (GtkEglImageWidgetStats *stats,
+                                                 guint                  *performed,
+                                                 guint                  *skipped)
+{
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET_STATS (stats));
+
+  if (performed)
+    *performed = g_atomic_int_get (&stats->context_switches);
+  if (skipped)
+    *skipped = g_atomic_int_get (&stats->context_switches_skipped);
+}
+
+guint
+gtk_egl_image_widget_stats_get_allocations (GtkEglImageWidgetStats *stats)
+{
+  g_return_val_if_fail (GTK_IS_EGL_IMAGE_WIDGET_STATS (stats), 0);
+
+  return g_atomic_int_get (&stats->allocations);
+}
+
+void
+gtk_egl_image_widget_stats_reset (GtkEglImageWidgetStats *stats)
+{
+  g_return_if_fail (GTK_IS_EGL_IMAGE_WIDGET_STATS (stats));
+
+  g_mutex_lock (&stats->mutex);
+  memset (stats->stages, 0, sizeof stats->stages);
+  g_mutex_unlock (&stats->mutex);
+  g_atomic_int_set (&stats->context_switches, 0);
+  g_atomic_int_set (&stats->context_switches_skipped, 0);
+  g_atomic_int_set (&stats->allocations, 0);
+}
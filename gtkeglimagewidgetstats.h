@@ -0,0 +1,31 @@
+#pragma once
+
+#include <gtk/gtk.h>
+
+typedef enum
+{
+  GTK_EGL_IMAGE_WIDGET_STAGE_RENDER,
+  GTK_EGL_IMAGE_WIDGET_STAGE_EXPORT,
+  GTK_EGL_IMAGE_WIDGET_STAGE_IMPORT,
+  GTK_EGL_IMAGE_WIDGET_STAGE_READBACK,
+  GTK_EGL_IMAGE_WIDGET_STAGE_SNAPSHOT,
+  GTK_EGL_IMAGE_WIDGET_STAGE_GPU_IMPORT,
+  GTK_EGL_IMAGE_WIDGET_N_STAGES
+} GtkEglImageWidgetStage;
+
+#define GTK_TYPE_EGL_IMAGE_WIDGET_STATS (gtk_egl_image_widget_stats_get_type ())
+G_DECLARE_FINAL_TYPE (GtkEglImageWidgetStats, gtk_egl_image_widget_stats, GTK, EGL_IMAGE_WIDGET_STATS, GObject)
+
+const char *gtk_egl_image_widget_stats_get_stage_name (GtkEglImageWidgetStage  stage);
+guint       gtk_egl_image_widget_stats_get_n_samples  (GtkEglImageWidgetStats *stats,
+                                                       GtkEglImageWidgetStage  stage);
+gboolean    gtk_egl_image_widget_stats_get_timing     (GtkEglImageWidgetStats *stats,
+                                                       GtkEglImageWidgetStage  stage,
+                                                       gint64                 *min,
+                                                       gint64                 *avg,
+                                                       gint64                 *p99);
+void        gtk_egl_image_widget_stats_get_context_switches (GtkEglImageWidgetStats *stats,
+                                                             guint                  *performed,
+                                                             guint                  *skipped);
+guint       gtk_egl_image_widget_stats_get_allocations (GtkEglImageWidgetStats *stats);
+void        gtk_egl_image_widget_stats_reset          (GtkEglImageWidgetStats *stats);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "gtkeglimagewidgetstats.h"
+
+GtkEglImageWidgetStats *gtk_egl_image_widget_stats_new        (void);
+void                    gtk_egl_image_widget_stats_add_sample (GtkEglImageWidgetStats *stats,
+                                                               GtkEglImageWidgetStage  stage,
+                                                               gint64                  usec);
+void                    gtk_egl_image_widget_stats_add_context_switch (GtkEglImageWidgetStats *stats,
+                                                                       gboolean                skipped);
+void                    gtk_egl_image_widget_stats_add_allocation (GtkEglImageWidgetStats *stats);
+void                    gtk_egl_image_widget_stats_frame_done (GtkEglImageWidgetStats *stats);